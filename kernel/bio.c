@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -23,69 +23,170 @@
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET 13
+
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets,
+// each a singly linked list through next with its own lock,
+// so lookups of different blocks don't contend.  A free
+// buffer (refcnt == 0) stays in its bucket, cached, until
+// bget() recycles the one with the oldest timestamp.
 struct {
+  // Serializes recycling, the only code that holds
+  // more than one bucket lock at a time.
   struct spinlock lock;
   struct buf buf[NBUF];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  struct spinlock bucketlock[NBUCKET];
+  struct buf bucket[NBUCKET];  // list heads, through next
+
+  // read-ahead statistics.
+  int rahit;    // bread()s of blocks that breadahead() fetched
+  int rawaste;  // read-ahead blocks recycled before use
+  int diskread; // bread()s that had to wait for the disk
 } bcache;
 
+static int
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBUCKET;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  int i;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++){
+    initlock(&bcache.bucketlock[i], "bcache.bucket");
+    bcache.bucket[i].next = 0;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Spread the initially empty buffers over the buckets.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+    i = (b - bcache.buf) % NBUCKET;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->next = bcache.bucket[i].next;
+    bcache.bucket[i].next = b;
+  }
+}
+
+// Look for block on device dev in bucket h.
+// Caller must hold bcache.bucketlock[h].
+static struct buf*
+blookup(int h, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[h].next; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
   }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For read-ahead, return 0 instead if the block is already
+// cached or if there is no unused buffer.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ra)
 {
-  struct buf *b;
+  struct buf *b, *pb, *best, *bestprev;
+  int h, i, besti;
 
-  acquire(&bcache.lock);
+  h = bhash(dev, blockno);
+  acquire(&bcache.bucketlock[h]);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  if((b = blookup(h, dev, blockno)) != 0){
+    if(ra){
+      release(&bcache.bucketlock[h]);
+      return 0;
     }
+    b->refcnt++;
+    release(&bcache.bucketlock[h]);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bcache.bucketlock[h]);
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Only one CPU at a time recycles, so holding two
+  // bucket locks below can't deadlock.
+  acquire(&bcache.lock);
+
+  // Another CPU may have cached the block while we
+  // held no bucket lock.
+  acquire(&bcache.bucketlock[h]);
+  if((b = blookup(h, dev, blockno)) != 0){
+    if(ra){
+      release(&bcache.bucketlock[h]);
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
+    }
+    b->refcnt++;
+    release(&bcache.bucketlock[h]);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.bucketlock[h]);
+
+  // Recycle the least recently used (LRU) unused buffer,
+  // keeping the lock of the bucket that holds the best
+  // candidate so far.
+  best = bestprev = 0;
+  besti = -1;
+  for(i = 0; i < NBUCKET; i++){
+    acquire(&bcache.bucketlock[i]);
+    int found = 0;
+    for(pb = &bcache.bucket[i]; pb->next; pb = pb->next){
+      b = pb->next;
+      if(b->refcnt == 0 && (best == 0 || b->timestamp < best->timestamp)){
+        best = b;
+        bestprev = pb;
+        found = 1;
+      }
+    }
+    if(found){
+      if(besti >= 0)
+        release(&bcache.bucketlock[besti]);
+      besti = i;
+    } else {
+      release(&bcache.bucketlock[i]);
+    }
+  }
+  if(best == 0){
+    if(ra){
+      release(&bcache.lock);
+      return 0;
     }
+    panic("bget: no buffers");
   }
-  panic("bget: no buffers");
+
+  // Move it to bucket h.
+  if(besti != h){
+    bestprev->next = best->next;
+    release(&bcache.bucketlock[besti]);
+    acquire(&bcache.bucketlock[h]);
+    best->next = bcache.bucket[h].next;
+    bcache.bucket[h].next = best;
+  }
+  best->dev = dev;
+  best->blockno = blockno;
+  best->valid = 0;
+  best->refcnt = 1;
+  if(best->readahead){
+    best->readahead = 0;
+    __sync_fetch_and_add(&bcache.rawaste, 1);
+  }
+  release(&bcache.bucketlock[h]);
+  release(&bcache.lock);
+  acquiresleep(&best->lock);
+  return best;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,11 +195,70 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
+    __sync_fetch_and_add(&bcache.diskread, 1);
     virtio_disk_rw(b, 0);
     b->valid = 1;
   }
+  if(b->readahead){
+    b->readahead = 0;
+    __sync_fetch_and_add(&bcache.rahit, 1);
+  }
+  return b;
+}
+
+// Start reading the n indicated blocks into the cache, skipping
+// any that are already cached, and return without waiting.
+// Each buffer stays locked until its read completes and
+// virtio_disk_intr() calls bdone().
+void
+breadahead(uint dev, uint *blocknos, int n)
+{
+  struct buf *b;
+  int i, submitted = 0;
+
+  for(i = 0; i < n; i++){
+    if((b = bget(dev, blocknos[i], 1)) == 0)
+      continue;
+    b->readahead = 1;
+    b->async = 1;
+    virtio_disk_submit(b, 0);
+    submitted = 1;
+  }
+  if(submitted)
+    virtio_disk_kick();
+}
+
+// Called by virtio_disk_intr() when an asynchronous read
+// started by breadahead() completes.  Release the buffer
+// on behalf of the process that started the read.
+void
+bdone(struct buf *b)
+{
+  int h;
+
+  b->async = 0;
+  b->valid = 1;
+  releasesleep(&b->lock);
+
+  h = bhash(b->dev, b->blockno);
+  acquire(&bcache.bucketlock[h]);
+  b->refcnt--;
+  if (b->refcnt == 0)
+    b->timestamp = ticks;
+  release(&bcache.bucketlock[h]);
+}
+
+// Return a locked buf for a block that the caller will
+// overwrite entirely, without reading it from disk.
+struct buf*
+bgetnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  b->valid = 1;
   return b;
 }
 
@@ -111,43 +271,87 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
-// Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Write the contents of n locked bufs to disk,
+// queueing them all before waiting for any.
 void
-brelse(struct buf *b)
+bwritev(struct buf **bufs, int n)
 {
-  if(!holdingsleep(&b->lock))
-    panic("brelse");
+  for(int i = 0; i < n; i++)
+    if(!holdingsleep(&bufs[i]->lock))
+      panic("bwritev");
+  virtio_disk_rwv(bufs, n, 1);
+}
+
+// Release a locked buffer, stamping it with timestamp
+// for LRU recycling if no one else is using it.
+static void
+bput(struct buf *b, uint timestamp)
+{
+  int h;
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  h = bhash(b->dev, b->blockno);
+  acquire(&bcache.bucketlock[h]);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->timestamp = timestamp;
   }
-  
-  release(&bcache.lock);
+  release(&bcache.bucketlock[h]);
+}
+
+// Release a locked buffer.
+// Stamp it with the time of last use for LRU recycling.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+  bput(b, ticks);
+}
+
+// Release a locked buffer that won't be needed again soon,
+// a block of file data that the page cache now holds, so
+// that bget() recycles it before any metadata block.
+void
+bdrop(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bdrop");
+  bput(b, 0);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucketlock[h]);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucketlock[h]);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucketlock[h]);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bcache.bucketlock[h]);
 }
 
+// Print buffer cache lock statistics.  For debugging.
+void
+bcachedump(void)
+{
+  int n = 0, nts = 0;
 
+  for(int i = 0; i < NBUCKET; i++){
+    n += bcache.bucketlock[i].n;
+    nts += bcache.bucketlock[i].nts;
+  }
+  printf("bcache: bucket acquires %d spins %d, recycle acquires %d spins %d\n",
+         n, nts, bcache.lock.n, bcache.lock.nts);
+  printf("bcache: read-ahead hits %d wasted %d, disk reads %d\n",
+         bcache.rahit, bcache.rawaste, bcache.diskread);
+}
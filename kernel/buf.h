@@ -1,12 +1,14 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int async;   // release when the disk is done (read-ahead)
+  int readahead; // read ahead, not yet used by bread()
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint timestamp;   // ticks at last brelse(), for LRU
+  struct buf *next; // hash bucket list
   uchar data[BSIZE];
 };
 
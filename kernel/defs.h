@@ -2,6 +2,7 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct page;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -12,10 +13,16 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bgetnew(uint, uint);
+void            breadahead(uint, uint*, int);
+void            bdone(struct buf*);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bdrop(struct buf*);
+void            bcachedump(void);
 
 // console.c
 void            consoleinit(void);
@@ -24,15 +31,19 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execfault(struct proc*, uint64);
 
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
-int             fileread(struct file*, uint64, int n);
+int             fileread(struct file*, int, uint64, int n);
 int             filestat(struct file*, uint64 addr);
-int             filewrite(struct file*, uint64, int n);
+int             filewrite(struct file*, int, uint64, int n);
+int             filesplice(struct file*, struct file*, int);
+int             filepread(struct file*, int, uint64, int, uint);
+int             filepwrite(struct file*, int, uint64, int, uint);
 
 // fs.c
 void            fsinit(int);
@@ -41,6 +52,8 @@ struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
+int             imapshared(struct inode*, int);
+int             iexec(struct inode*, int);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
@@ -50,6 +63,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+struct page*    ipage(struct inode*, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -63,6 +77,10 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kref(void *);
+int             krefcount(void *);
+int             kfreepages(void);
+void            kmemdump(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -70,17 +88,50 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// mmap.c
+uint64          mmap(struct file*, uint64, int, int, uint);
+int             munmap(uint64, uint64);
+void            munmapall(struct proc*);
+int             mmapfill(struct proc*);
+int             mmapcopy(struct proc*, struct proc*);
+uint64          mmapbase(struct proc*);
+int             vmafault(struct proc*, uint64);
+
+// ring.c
+uint64          ringsetup(void);
+void            ringfree(struct proc*);
+int             ringenter(int);
+
+// pcache.c
+void            pcacheinit(void);
+struct page*    pget(struct inode*, uint);
+void            prelse(struct page*);
+int             punshare(struct page*);
+void            pinval(struct inode*);
+int             pcachereclaim(void);
+void            pcachedump(void);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int);
+int             pipewrite(struct pipe*, int, uint64, int);
+int             pipesplicein(struct pipe*, struct file*, int);
+int             pipespliceout(struct pipe*, struct file*, int);
 
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// prof.c
+extern int      profiling;
+void            profinit(void);
+void            profsample(uint64, int);
+void            profstart(void);
+int             profstop(void);
+int             profread(uint64, int);
+
 // proc.c
 int             cpuid(void);
 void            exit(int);
@@ -89,6 +140,7 @@ int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             kthread(void (*)(void), char*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -101,6 +153,7 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+int             timeslice(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -112,15 +165,21 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            freelock(struct spinlock*);
+void            lockinit(void);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockregister(void*, int);
+void            lockunregister(int);
+int             lockstats(uint64, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            freesleeplock(struct sleeplock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -138,6 +197,13 @@ int             argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             sysstats(uint64, int);
+
+// timer.c
+int             timersleep(uint64);
+void            timerexpire(uint64);
+void            clockset(void);
+void            kickidle(void);
 
 // trap.c
 extern uint     ticks;
@@ -164,9 +230,14 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64);
+void            uvmprefault(uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -181,6 +252,10 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwv(struct buf **, int, int);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_kick(void);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
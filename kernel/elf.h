@@ -40,3 +40,34 @@ struct proghdr {
 #define ELF_PROG_FLAG_EXEC      1
 #define ELF_PROG_FLAG_WRITE     2
 #define ELF_PROG_FLAG_READ      4
+
+// Section header
+struct secthdr {
+  uint32 name;
+  uint32 type;
+  uint64 flags;
+  uint64 addr;
+  uint64 off;
+  uint64 size;
+  uint32 link;
+  uint32 info;
+  uint64 addralign;
+  uint64 entsize;
+};
+
+// Values for Secthdr type
+#define ELF_SECT_SYMTAB         2
+
+// Symbol table entry
+struct elfsym {
+  uint32 name;
+  uchar info;
+  uchar other;
+  ushort shndx;
+  uint64 value;
+  uint64 size;
+};
+
+// Symbol type, in the low bits of Elfsym info
+#define ELF_SYM_TYPE(info)      ((info) & 0xf)
+#define ELF_SYM_FUNC            2
@@ -5,10 +5,29 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "page.h"
 #include "elf.h"
 
 static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
 
+// ELF segment flags to PTE permission bits.
+static int
+flags2perm(int flags)
+{
+  int perm = 0;
+
+  if(flags & ELF_PROG_FLAG_EXEC)
+    perm |= PTE_X;
+  if(flags & ELF_PROG_FLAG_WRITE)
+    perm |= PTE_W;
+  if(flags & ELF_PROG_FLAG_READ)
+    perm |= PTE_R;
+  return perm;
+}
+
 int
 exec(char *path, char **argv)
 {
@@ -16,8 +35,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *execip = 0, *oldip;
   struct proghdr ph;
+  struct execseg seg[NEXECSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -38,7 +59,9 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments, to be paged in from ip by
+  // execfault() as the program touches them.  Load any
+  // segments beyond the first NEXECSEG into memory now.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -48,17 +71,36 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.off + ph.filesz < ph.off)
+      goto bad;
+    if(ph.vaddr % PGSIZE != 0)
+      goto bad;
+    if(ph.vaddr < PGROUNDUP(sz) || ph.vaddr + ph.memsz > MMAPTOP)
+      goto bad;
+    if(nseg < NEXECSEG){
+      seg[nseg].va = ph.vaddr;
+      seg[nseg].memsz = ph.memsz;
+      seg[nseg].filesz = ph.filesz;
+      seg[nseg].off = ph.off;
+      seg[nseg].perm = flags2perm(ph.flags);
+      nseg++;
+      sz = ph.vaddr + ph.memsz;
+      continue;
+    }
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     sz = sz1;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  // A file mapped MAP_SHARED can't be run; see iexec().
+  if(iexec(ip, 1) < 0)
+    goto bad;
+  // Keep the reference to ip for execfault().
+  iunlock(ip);
   end_op();
+  execip = ip;
   ip = 0;
 
   p = myproc();
@@ -67,6 +109,8 @@ exec(char *path, char **argv)
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
+  if(sz + 2*PGSIZE > MMAPTOP)
+    goto bad;
   uint64 sz1;
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
@@ -109,12 +153,24 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  munmapall(p);
   oldpagetable = p->pagetable;
+  oldip = p->execip;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->execip = execip;
+  p->nseg = nseg;
+  memmove(p->seg, seg, sizeof(seg));
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  ringfree(p);
+  if(oldip){
+    iexec(oldip, -1);
+    begin_op();
+    iput(oldip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -125,9 +181,105 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(execip){
+    iexec(execip, -1);
+    begin_op();
+    iput(execip);
+    end_op();
+  }
   return -1;
 }
 
+// Return the physical page holding the PGSIZE bytes of ip at
+// page-aligned offset off, with a reference for the caller.
+// The page is the page cache's own, so processes running the
+// same program share it.  Caller must hold ip->lock.
+// Returns 0 on failure.
+static uint64
+execpage(struct inode *ip, uint off)
+{
+  struct page *pg;
+  char *pa;
+
+  if((pg = ipage(ip, off / PGSIZE)) == 0)
+    return 0;
+  pa = pg->data;
+  kref(pa);
+  prelse(pg);
+  return (uint64)pa;
+}
+
+// Page in the page of p's program that holds va, if exec()
+// left va's segment to be demand paged.  Reading the page may
+// sleep and locks the executable, so a caller that holds a
+// spinlock or an inode lock gets a failure for pages that come
+// from the file; file reads and writes page in their user
+// buffers with uvmprefault() before they lock the inode.
+// Returns 0 on success, -1 on failure, and 1 if va isn't in
+// a demand-paged segment.
+int
+execfault(struct proc *p, uint64 va)
+{
+  struct execseg *s;
+  struct inode *ip = p->execip;
+  uint64 segoff, n, pa;
+  int perm;
+  char *mem;
+
+  if(va >= p->sz)
+    return 1;
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      break;
+  if(s == &p->seg[p->nseg])
+    return 1;
+
+  va = PGROUNDDOWN(va);
+  if(walkaddr(p->pagetable, va) != 0)
+    return -1;  // mapped; a protection fault.
+  segoff = va - s->va;
+  n = segoff < s->filesz ? s->filesz - segoff : 0;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  perm = s->perm | PTE_U;
+
+  if(n > 0 && (!intr_get() || p->nilock > 0))
+    return -1;
+
+  if(n == PGSIZE && (s->off + segoff) % PGSIZE == 0){
+    // Share the page cache's page.
+    ilock(ip);
+    pa = execpage(ip, s->off + segoff);
+    iunlock(ip);
+    if(pa == 0)
+      return -1;
+    if(perm & PTE_W)
+      perm = (perm & ~PTE_W) | PTE_COW;
+  } else {
+    // The segment's last file page, bss, or a page that isn't
+    // page-aligned in the file: a private page.
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(n > 0){
+      ilock(ip);
+      if(readi(ip, 0, (uint64)mem, s->off + segoff, n) != n){
+        iunlock(ip);
+        kfree(mem);
+        return -1;
+      }
+      iunlock(ip);
+    }
+    pa = (uint64)mem;
+  }
+
+  if(mappages(p->pagetable, va, PGSIZE, pa, perm) != 0){
+    kfree((void*)pa);
+    return -1;
+  }
+  return 0;
+}
+
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
 // and the pages from va to va+sz must already be mapped.
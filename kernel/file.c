@@ -102,9 +102,10 @@ filestat(struct file *f, uint64 addr)
 }
 
 // Read from file f.
-// addr is a user virtual address.
+// If user_dst==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
 int
-fileread(struct file *f, uint64 addr, int n)
+fileread(struct file *f, int user_dst, uint64 addr, int n)
 {
   int r = 0;
 
@@ -112,14 +113,16 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, user_dst, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    r = devsw[f->major].read(user_dst, addr, n);
   } else if(f->type == FD_INODE){
+    if(user_dst)
+      uvmprefault(addr, n);
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, user_dst, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
   } else {
@@ -129,50 +132,65 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Write n bytes to inode ip at *off, advancing *off.
+// Returns the number of bytes written, which is less than n
+// if writei() stopped early, or -1 if it wrote none.
+static int
+inodewrite(struct inode *ip, int user_src, uint64 addr, uint *off, int n)
+{
+  int r = 0;
+
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    if(user_src)
+      uvmprefault(addr + i, n1);
+    begin_op();
+    ilock(ip);
+    if ((r = writei(ip, user_src, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(ip);
+    end_op();
+
+    if(r > 0)
+      i += r;
+    if(r != n1){
+      // error from writei
+      break;
+    }
+  }
+  return i > 0 || n == 0 ? i : -1;
+}
+
 // Write to file f.
-// addr is a user virtual address.
+// If user_src==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+filewrite(struct file *f, int user_src, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, user_src, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
+    ret = devsw[f->major].write(user_src, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    ret = inodewrite(f->ip, user_src, addr, &f->off, n);
   } else {
     panic("filewrite");
   }
@@ -180,3 +198,51 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Read from file f at offset off, without using or changing
+// the file offset.  Only for inodes.
+// If user_dst==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+int
+filepread(struct file *f, int user_dst, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  if(user_dst)
+    uvmprefault(addr, n);
+  ilock(f->ip);
+  r = readi(f->ip, user_dst, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Write to file f at offset off, without using or changing
+// the file offset.  Only for inodes.
+// If user_src==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+int
+filepwrite(struct file *f, int user_src, uint64 addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f->ip, user_src, addr, &off, n);
+}
+
+// Move up to n bytes from file in to file out without
+// copying them through user space.  One of the files must be
+// a pipe, and the data goes straight between the pipe's
+// buffer and the other file (for an inode, its blocks in the
+// buffer cache).
+// Returns the number of bytes moved, or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_PIPE && out->type != FD_PIPE)
+    return pipespliceout(in->pipe, out, n);
+  if(in->type != FD_PIPE && out->type == FD_PIPE)
+    return pipesplicein(out->pipe, in, n);
+  return -1;
+}
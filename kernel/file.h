@@ -18,6 +18,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nshared;        // MAP_SHARED mappings of the file
+  int nexec;          // Processes running the file
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +28,20 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  // in-core only: a run of len contiguous disk blocks starting
+  // at addr that holds file blocks bn..bn+len-1, found by bmap()
+  // in an indirect block, so that later lookups in the run need
+  // not read the indirect blocks again.  protected by lock.
+  struct {
+    uint bn;
+    uint addr;
+    uint len;
+  } extent;
+
+  // in-core only: sequential read detection for read-ahead.
+  uint ranext;        // block after the last one readi() read
 };
 
 // map major device number to device functions.
@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "page.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -166,9 +167,11 @@ bfree(int dev, uint b)
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// It also protects ip->nshared and ip->nexec, which fork()
+// changes while it holds a spin-lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// nshared, nexec, dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
@@ -266,6 +269,8 @@ iget(uint dev, uint inum)
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
+  ip->nshared = 0;
+  ip->nexec = 0;
   ip->valid = 0;
   release(&icache.lock);
 
@@ -283,6 +288,46 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Count a MAP_SHARED mapping of ip being made (delta 1) or
+// removed (delta -1).  While ip has any, writei() changes
+// mapped pages in place, so that the mappings see the write.
+// That must not change the text of a running program, so a
+// file being executed can't be mapped MAP_SHARED.
+// Returns 0, or -1, counting nothing, if ip is being executed.
+int
+imapshared(struct inode *ip, int delta)
+{
+  acquire(&icache.lock);
+  if(delta > 0 && ip->nexec > 0){
+    release(&icache.lock);
+    return -1;
+  }
+  ip->nshared += delta;
+  if(ip->nshared < 0)
+    panic("imapshared");
+  release(&icache.lock);
+  return 0;
+}
+
+// Count a process starting (delta 1) or ceasing (delta -1)
+// to run the program in ip.  For the reason above, a file
+// mapped MAP_SHARED can't be executed.
+// Returns 0, or -1, counting nothing, if ip is mapped shared.
+int
+iexec(struct inode *ip, int delta)
+{
+  acquire(&icache.lock);
+  if(delta > 0 && ip->nshared > 0){
+    release(&icache.lock);
+    return -1;
+  }
+  ip->nexec += delta;
+  if(ip->nexec < 0)
+    panic("iexec");
+  release(&icache.lock);
+  return 0;
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -295,6 +340,7 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquiresleep(&ip->lock);
+  myproc()->nilock++;
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -306,6 +352,8 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->extent.len = 0;
+    ip->ranext = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -319,6 +367,7 @@ iunlock(struct inode *ip)
   if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
+  myproc()->nilock--;
   releasesleep(&ip->lock);
 }
 
@@ -370,14 +419,42 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The next NDINDIRECT
+// blocks are listed in the NINDIRECT indirect blocks whose
+// numbers are listed in the doubly-indirect block
+// ip->addrs[NDIRECT+1].
+
+// Return entry i of indirect block addr, which maps file
+// block fbn, allocating a data block if necessary.
+// Remember the run of contiguous disk blocks that starts
+// there in ip->extent.
+static uint
+bmapind(struct inode *ip, uint addr, uint i, uint fbn)
+{
+  uint n, *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = balloc(ip->dev);
+    log_write(bp);
+  }
+  for(n = 1; i + n < NINDIRECT && a[i+n] == addr + n; n++)
+    ;
+  ip->extent.bn = fbn;
+  ip->extent.addr = addr;
+  ip->extent.len = n;
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, *a, fbn;
   struct buf *bp;
 
   if(bn < NDIRECT){
@@ -385,25 +462,58 @@ bmap(struct inode *ip, uint bn)
       ip->addrs[bn] = addr = balloc(ip->dev);
     return addr;
   }
+
+  // Within the last run found in an indirect block?
+  // (Allocated entries never change until itrunc().)
+  if(bn - ip->extent.bn < ip->extent.len)
+    return ip->extent.addr + (bn - ip->extent.bn);
+
+  fbn = bn;
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
       ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    return bmapind(ip, addr, bn, fbn);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load doubly-indirect block, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[bn / NINDIRECT]) == 0){
+      a[bn / NINDIRECT] = addr = balloc(ip->dev);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    return bmapind(ip, addr, bn % NINDIRECT, fbn);
   }
 
   panic("bmap: out of range");
 }
 
+// Free indirect block addr and the data blocks it lists.
+static void
+itruncind(struct inode *ip, uint addr)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j])
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -413,6 +523,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pinval(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -421,17 +533,23 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip, ip->addrs[NDIRECT]);
+    ip->addrs[NDIRECT] = 0;
+  }
+
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
     a = (uint*)bp->data;
     for(j = 0; j < NINDIRECT; j++){
       if(a[j])
-        bfree(ip->dev, a[j]);
+        itruncind(ip, a[j]);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
   }
 
+  ip->extent.len = 0;
   ip->size = 0;
   iupdate(ip);
 }
@@ -448,60 +566,198 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
-// Read data from inode.
+// Pages to read ahead of a sequential reader.
+#define READAHEAD 4
+
+// Blocks per page of the page cache.
+#define PGBLOCKS (PGSIZE/BSIZE)
+
+// Fill the npg pages pg[] of ip from disk, zeroing the parts
+// past the end of the file.  All of their blocks are queued
+// before waiting for any.  The blocks come through the buffer
+// cache, which may hold data that the log hasn't yet
+// installed, but are dropped from it right away.
+// Caller must hold ip->lock.
+static void
+pfill(struct inode *ip, struct page **pg, int npg)
+{
+  uint blocknos[(READAHEAD+1)*PGBLOCKS];
+  uint bn, nblocks;
+  struct buf *bp;
+  int i, j, n, nb[READAHEAD+1];
+
+  if(npg > READAHEAD+1)
+    panic("pfill");
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  n = 0;
+  for(i = 0; i < npg; i++){
+    bn = pg[i]->pgno * PGBLOCKS;
+    for(nb[i] = 0; nb[i] < PGBLOCKS && bn + nb[i] < nblocks; nb[i]++)
+      blocknos[n++] = bmap(ip, bn + nb[i]);
+  }
+
+  breadahead(ip->dev, blocknos, n);
+  n = 0;
+  for(i = 0; i < npg; i++){
+    for(j = 0; j < nb[i]; j++){
+      bp = bread(ip->dev, blocknos[n++]);
+      memmove(pg[i]->data + j*BSIZE, bp->data, BSIZE);
+      bdrop(bp);
+    }
+    memset(pg[i]->data + nb[i]*BSIZE, 0, (PGBLOCKS - nb[i])*BSIZE);
+    if(pg[i]->pgno == ip->size / PGSIZE)
+      memset(pg[i]->data + ip->size % PGSIZE, 0, PGSIZE - ip->size % PGSIZE);
+    pg[i]->valid = 1;
+  }
+}
+
+// Called when a sequential reader of ip needs page pg, which
+// isn't valid.  Fill it together with up to READAHEAD of the
+// pages after it that aren't cached yet, as one batch of
+// disk reads, so that the reader finds those pages in the
+// page cache.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, struct page *pg)
+{
+  struct page *ra[READAHEAD+1], *q;
+  uint pgno, npages;
+  int i, n;
+
+  npages = (ip->size + PGSIZE - 1) / PGSIZE;
+  ra[0] = pg;
+  for(n = 1, pgno = pg->pgno + 1; n <= READAHEAD && pgno < npages; n++, pgno++){
+    if((q = pget(ip, pgno)) == 0)
+      break;
+    if(q->valid){
+      prelse(q);
+      break;
+    }
+    ra[n] = q;
+  }
+  pfill(ip, ra, n);
+  for(i = 1; i < n; i++)
+    prelse(ra[i]);
+}
+
+// Return page pgno of ip's file, read in if it wasn't
+// cached, with a reference that the caller drops with
+// prelse().  For mapping file pages into processes.
+// Caller must hold ip->lock.  Returns 0 if out of memory.
+struct page*
+ipage(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+
+  if((pg = pget(ip, pgno)) == 0)
+    return 0;
+  if(!pg->valid)
+    pfill(ip, &pg, 1);
+  return pg;
+}
+
+// Read data from inode, through the page cache.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, bn;
+  struct page *pg;
+  int seq;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
 
+  // Sequential if this read starts in the block after the
+  // last one read, or continues within that last block.
+  bn = off/BSIZE;
+  seq = n > 0 && (bn == ip->ranext || bn + 1 == ip->ranext);
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
+    if((pg = pget(ip, off/PGSIZE)) == 0)
       break;
+    if(!pg->valid){
+      if(seq)
+        readahead(ip, pg);
+      else
+        pfill(ip, &pg, 1);
     }
-    brelse(bp);
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    ip->ranext = (off + m - 1)/BSIZE + 1;
+    if(either_copyout(user_dst, dst, pg->data + (off % PGSIZE), m) == -1) {
+      prelse(pg);
+      break;
+    }
+    prelse(pg);
   }
   return tot;
 }
 
-// Write data to inode.
+// Write data to inode, through the page cache.  The blocks
+// written still go through the log, for crash safety, but
+// are dropped from the buffer cache once committed.  If the
+// file has MAP_SHARED mappings, pages that processes map are
+// changed in place, and every mapping of them sees the write;
+// otherwise the processes keep the old contents.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
 // otherwise, src is a kernel address.
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, bn;
+  struct page *pg;
   struct buf *bp;
+  int shared;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  acquire(&icache.lock);
+  shared = ip->nshared > 0;
+  release(&icache.lock);
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
-      brelse(bp);
+    if((pg = pget(ip, off/PGSIZE)) == 0)
+      break;
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if(!pg->valid){
+      // no need to read what the write will replace.
+      if(m == PGSIZE || PGROUNDDOWN(off) >= ip->size){
+        memset(pg->data, 0, PGSIZE);
+        pg->valid = 1;
+      } else {
+        pfill(ip, &pg, 1);
+      }
+    } else if(!shared && punshare(pg) < 0){
+      prelse(pg);
       break;
     }
-    log_write(bp);
-    brelse(bp);
+    if(either_copyin(pg->data + (off % PGSIZE), user_src, src, m) == -1) {
+      // partly overwritten; read it again next time, unless
+      // a process maps it and may have stored to it.
+      if(krefcount(pg->data) == 1)
+        pg->valid = 0;
+      prelse(pg);
+      break;
+    }
+    for(bn = off/BSIZE; bn <= (off + m - 1)/BSIZE; bn++){
+      bp = bgetnew(ip->dev, bmap(ip, bn));
+      memmove(bp->data, pg->data + (bn % PGBLOCKS)*BSIZE, BSIZE);
+      log_write(bp);
+      bdrop(bp);
+    }
+    prelse(pg);
   }
 
-  if(n > 0){
+  if(tot > 0){
     if(off > ip->size)
       ip->size = off;
     // write the i-node back to disk even if the size didn't change
@@ -510,7 +766,9 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     iupdate(ip);
   }
 
-  return n;
+  if(tot == 0 && n > 0)
+    return -1;
+  return tot;
 }
 
 // Directories
@@ -574,7 +832,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
+    return -1;
 
   return 0;
 }
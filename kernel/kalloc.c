@@ -14,19 +14,36 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// Pages moved from another CPU's free list by one steal.
+#define NSTEAL 32
+
 struct run {
   struct run *next;
 };
 
+// Each CPU has its own free list and lock, so that kalloc()
+// and kfree() on different CPUs don't contend.  A CPU whose
+// list is empty steals a batch of pages from another CPU.
 struct {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;   // pages on freelist
+  int nsteal;  // pages stolen from other CPUs
+} kmem[NCPU];
+
+// Reference counts of physical pages, so that COW fork can
+// share a page between page tables.  kalloc() sets a page's
+// count to 1, kref() adds a reference, and kfree() drops one,
+// freeing the page when none remain.  Updated atomically,
+// so no lock is needed.
+static int pageref[(PHYSTOP - KERNBASE) / PGSIZE];
+#define PAGEREF(pa) pageref[((uint64)(pa) - KERNBASE) / PGSIZE]
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +52,75 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    PAGEREF(p) = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last one.
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(void *pa)
 {
   struct run *r;
+  int id, ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  ref = __sync_sub_and_fetch(&PAGEREF(pa), 1);
+  if(ref < 0)
+    panic("kfree: ref");
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  acquire(&kmem[id].lock);
+  r->next = kmem[id].freelist;
+  kmem[id].freelist = r;
+  kmem[id].nfree++;
+  release(&kmem[id].lock);
+  pop_off();
+}
+
+// Take up to NSTEAL pages from some other CPU's free list
+// and return them as a chain.  Called with interrupts off
+// and without holding kmem[id].lock, so that two CPUs
+// stealing from each other can't deadlock.
+static struct run*
+steal(int id)
+{
+  struct run *first, *last;
+  int i, n;
+
+  for(i = 1; i < NCPU; i++){
+    int victim = (id + i) % NCPU;
+    acquire(&kmem[victim].lock);
+    first = kmem[victim].freelist;
+    if(first == 0){
+      release(&kmem[victim].lock);
+      continue;
+    }
+    last = first;
+    for(n = 1; n < NSTEAL && last->next; n++)
+      last = last->next;
+    kmem[victim].freelist = last->next;
+    kmem[victim].nfree -= n;
+    release(&kmem[victim].lock);
+    last->next = 0;
+    return first;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +129,87 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct run *r, *chain;
+  int id, n;
+
+  push_off();
+  id = cpuid();
+  acquire(&kmem[id].lock);
+  r = kmem[id].freelist;
+  if(r){
+    kmem[id].freelist = r->next;
+    kmem[id].nfree--;
+  }
+  release(&kmem[id].lock);
+
+  if(r == 0 && (chain = steal(id)) != 0){
+    // Keep the first stolen page, put the rest on our own list.
+    r = chain;
+    chain = chain->next;
+    n = 1;
+    acquire(&kmem[id].lock);
+    while(chain){
+      struct run *next = chain->next;
+      chain->next = kmem[id].freelist;
+      kmem[id].freelist = chain;
+      kmem[id].nfree++;
+      chain = next;
+      n++;
+    }
+    kmem[id].nsteal += n;
+    release(&kmem[id].lock);
+  }
+  pop_off();
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  // Out of memory: take pages back from the page cache.
+  if(r == 0 && pcachereclaim() > 0)
+    return kalloc();
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    PAGEREF(r) = 1;
+  }
   return (void*)r;
 }
+
+// Add a reference to an allocated page of physical memory.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  if(__sync_fetch_and_add(&PAGEREF(pa), 1) < 1)
+    panic("kref: free page");
+}
+
+// Return the number of references to a page of physical memory.
+int
+krefcount(void *pa)
+{
+  return PAGEREF(pa);
+}
+
+// Return the number of free pages, summed over the CPUs
+// without locking, so only approximately.
+int
+kfreepages(void)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    n += kmem[i].nfree;
+  return n;
+}
+
+// Print per-CPU allocator statistics.  For debugging.
+// Called from procdump(); no locks, like procdump.
+void
+kmemdump(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    if(kmem[i].lock.n == 0)
+      continue;
+    printf("kmem cpu %d: free %d stolen %d acquires %d spins %d\n",
+           i, kmem[i].nfree, kmem[i].nsteal, kmem[i].lock.n, kmem[i].lock.nts);
+  }
+}
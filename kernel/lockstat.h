@@ -0,0 +1,13 @@
+// Contention statistics of a lock, as returned by lockstat().
+
+#define LOCK_SPIN  0  // struct spinlock
+#define LOCK_SLEEP 1  // struct sleeplock
+
+struct lockstat {
+  char name[16];
+  int type;          // LOCK_SPIN or LOCK_SLEEP
+  uint n;            // acquisitions
+  uint ncontend;     // acquisitions that had to wait
+  uint nspin;        // failed test-and-set attempts (LOCK_SPIN)
+  uint64 usec;       // total time spent waiting (microseconds)
+};
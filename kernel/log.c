@@ -21,35 +21,70 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// Group commit: when the last outstanding end_op() finds
+// room in the log for more, it yields the CPU once before
+// committing, so that processes about to start an FS system
+// call can join the transaction instead of waiting for the
+// commit to finish.  Whoever ends last after that commits.
+//
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+// The on-disk log is two regions of log.size blocks each,
+// used alternately by successive transactions. Each region:
+//   header block, containing seq and block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, but the blocks of a commit
+// are written to the disk in batches of LOGBATCH, with one
+// notification of the device per batch.
+//
+// A commit only writes the log; the logflush kernel thread
+// later installs the committed blocks to their home locations
+// and erases the region's header.  Until then the region can't
+// take another commit, so system calls wait for the checkpoint
+// only when both regions are full.  Recovery installs whatever
+// committed regions it finds in seq order.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint seq;  // commit order, for recovery
   int block[LOGSIZE];
 };
 
+// Blocks written to disk per batch by write_log() and
+// install_trans(); bounded so that a commit doesn't need
+// more than NBUF buffers.
+#define LOGBATCH 10
+
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // blocks per region, including the header
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int waiting;     // how many begin_op()s are waiting for log space.
   int dev;
-  struct logheader lh;
+  int cur;         // region the open transaction will commit to
+  uint seq;        // seq of the next commit
+  struct logheader lh;  // the open transaction
+  // per region: committed but not yet installed if n > 0.
+  // owned by logflush while n > 0.
+  struct logheader committed[2];
 };
 struct log log;
 
+// install_trans() writes home from these rather than through
+// the buffer cache, since cached copies of the blocks may
+// already hold later, uncommitted changes.
+// Used only by logflush, and by recovery before it starts.
+static struct buf installbuf[LOGBATCH];
+
 static void recover_from_log(void);
 static void commit();
+static void logflush(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -59,54 +94,75 @@ initlog(int dev, struct superblock *sb)
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog / 2;
   log.dev = dev;
+  if (log.size - 1 < LOGSIZE)
+    panic("initlog: log too small");
   recover_from_log();
+  if (kthread(logflush, "logflush") < 0)
+    panic("initlog: logflush");
 }
 
-// Copy committed blocks from log to their home location
+// Copy the blocks of committed transaction lh from log
+// region r to their home locations.  Unless recovering,
+// the cached blocks were pinned by log_write(); unpin them.
 static void
-install_trans(void)
+install_trans(int r, struct logheader *lh, int recovering)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  struct buf *ibufs[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < lh->n; tail += n) {
+    n = lh->n - tail;
+    if (n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      struct buf *lbuf = bread(log.dev, log.start+r*log.size+tail+i+1); // read log block
+      ibufs[i] = &installbuf[i];
+      ibufs[i]->dev = log.dev;
+      ibufs[i]->blockno = lh->block[tail+i];
+      memmove(ibufs[i]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    virtio_disk_rwv(ibufs, n, 1);  // write dsts to disk
+    if (!recovering) {
+      for (i = 0; i < n; i++) {
+        struct buf *dbuf = bread(log.dev, lh->block[tail+i]);
+        bunpin(dbuf);
+        brelse(dbuf);
+      }
+    }
   }
 }
 
-// Read the log header from disk into the in-memory log header
+// Read region r's log header from disk
 static void
-read_head(void)
+read_head(int r, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct buf *buf = bread(log.dev, log.start+r*log.size);
+  struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  lh->n = hb->n;
+  lh->seq = hb->seq;
+  for (i = 0; i < lh->n; i++) {
+    lh->block[i] = hb->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write a log header to region r on disk.
+// Writing a non-empty header is the true point
+// at which a transaction commits.
 static void
-write_head(void)
+write_head(int r, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(log.dev, log.start+r*log.size);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  hb->seq = lh->seq;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -115,10 +171,63 @@ write_head(void)
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct logheader *first, *second;
+  int r;
+
+  for (r = 0; r < 2; r++)
+    read_head(r, &log.committed[r]);
+
+  // if committed, copy from log to disk, oldest first.
+  first = &log.committed[0];
+  second = &log.committed[1];
+  if (first->n > 0 && second->n > 0 && second->seq < first->seq) {
+    first = &log.committed[1];
+    second = &log.committed[0];
+  }
+  install_trans(first - log.committed, first, 1);
+  install_trans(second - log.committed, second, 1);
+
+  for (r = 0; r < 2; r++) {
+    log.committed[r].n = 0;
+    write_head(r, &log.committed[r]); // clear the log
+  }
+  log.cur = 0;
+  log.seq = 1;
+}
+
+// Kernel thread that installs committed transactions
+// to their home locations, in commit order.
+static void
+logflush(void)
+{
+  struct logheader empty;
+  int r;
+
+  empty.n = 0;
+  empty.seq = 0;
+  for(;;){
+    acquire(&log.lock);
+    for(;;){
+      r = -1;
+      if(log.committed[0].n > 0)
+        r = 0;
+      if(log.committed[1].n > 0 &&
+         (r < 0 || log.committed[1].seq < log.committed[0].seq))
+        r = 1;
+      if(r >= 0)
+        break;
+      sleep(&log.committed, &log.lock);
+    }
+    release(&log.lock);
+
+    install_trans(r, &log.committed[r], 0);
+    write_head(r, &empty);  // Erase the transaction from the log
+
+    acquire(&log.lock);
+    log.committed[r].n = 0;
+    wakeup(&log.committed);  // commit() may be waiting for region r
+    release(&log.lock);
+  }
 }
 
 // called at the start of each FS system call.
@@ -131,7 +240,9 @@ begin_op(void)
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      log.waiting += 1;
       sleep(&log, &log.lock);
+      log.waiting -= 1;
     } else {
       log.outstanding += 1;
       release(&log.lock);
@@ -151,7 +262,17 @@ end_op(void)
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 && log.waiting == 0 &&
+     log.lh.n > 0 && log.lh.n + MAXOPBLOCKS <= LOGSIZE){
+    // group commit: let other processes join this
+    // transaction before committing it.
+    release(&log.lock);
+    yield();
+    acquire(&log.lock);
+    // if someone joined and is still running, or has
+    // already committed, there's nothing left to do.
+  }
+  if(log.outstanding == 0 && !log.committing){
     do_commit = 1;
     log.committing = 1;
   } else {
@@ -173,31 +294,53 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log region r.
 static void
-write_log(void)
+write_log(int r)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  struct buf *tos[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if (n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      tos[i] = bgetnew(log.dev, log.start+r*log.size+tail+i+1); // log block
+      struct buf *from = bread(log.dev, log.lh.block[tail+i]); // cache block
+      memmove(tos[i]->data, from->data, BSIZE);
+      brelse(from);
+    }
+    bwritev(tos, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(tos[i]);
   }
 }
 
 static void
 commit()
 {
+  int r = log.cur;
+
   if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+    // wait for logflush to finish installing the last
+    // transaction committed to this region.
+    acquire(&log.lock);
+    while (log.committed[r].n > 0)
+      sleep(&log.committed, &log.lock);
+    release(&log.lock);
+
+    log.lh.seq = log.seq++;
+    write_log(r);            // Write modified blocks from cache to log
+    write_head(r, &log.lh);  // Write header to disk -- the real commit
+
+    // Hand the transaction to logflush to install.
+    acquire(&log.lock);
+    log.committed[r] = log.lh;
+    log.cur = 1 - r;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    wakeup(&log.committed);
+    release(&log.lock);
   }
 }
 
@@ -232,4 +375,3 @@ log_write(struct buf *b)
   }
   release(&log.lock);
 }
-
@@ -11,6 +11,7 @@ void
 main()
 {
   if(cpuid() == 0){
+    lockinit();
     consoleinit();
     printfinit();
     printf("\n");
@@ -25,8 +26,10 @@ main()
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcacheinit();    // file page cache
     iinit();         // inode cache
     fileinit();      // file table
+    profinit();      // sampling profiler
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
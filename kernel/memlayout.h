@@ -27,6 +27,7 @@
 
 // local interrupt controller, which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
@@ -62,6 +63,21 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   URING (p->ring, once set up)
+//   USYSCALL (p->usyscall, read-only)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define URING (USYSCALL - PGSIZE)
+
+// mmap() places mappings downward from here.
+#define MMAPTOP URING
+
+// The contents of the USYSCALL page, from which ulib.c answers
+// getpid() and uptime() without a system call.
+struct usyscall {
+  int pid;              // Process ID
+  uint64 tickinterval;  // time CSR units per tick of uptime()
+  uint64 timefreq;      // time CSR units per second
+};
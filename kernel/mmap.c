@@ -0,0 +1,332 @@
+// Memory-mapped files and anonymous memory.
+//
+// Each process has a table of mappings (struct vma), placed
+// downward from MMAPTOP, above the heap.  Pages are allocated,
+// and read from the file, only when the process first touches
+// them (see vmafault()).  File pages are the page cache's own,
+// so a MAP_SHARED mapping and read() and write() of the file
+// see each other's changes; munmap(), exit() and exec() write
+// its dirty pages back to the file.  fork() pages in all of
+// the MAP_SHARED pages and shares them with the child, and
+// makes MAP_PRIVATE pages copy-on-write.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "page.h"
+#include "fcntl.h"
+
+// Return the lowest address of p's mappings, or MMAPTOP
+// if it has none.  The heap must stay below it.
+uint64
+mmapbase(struct proc *p)
+{
+  uint64 base = MMAPTOP;
+
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->addr && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Take a reference to the file of v, a new copy of a vma.
+// The vma copied already counts in imapshared(), so the
+// file can't be being executed.
+static void
+vmadup(struct vma *v)
+{
+  if(v->f == 0)
+    return;
+  filedup(v->f);
+  if((v->flags & MAP_SHARED) && imapshared(v->f->ip, 1) < 0)
+    panic("vmadup");
+}
+
+// Drop v's file, if any, and mark v unused.
+static void
+vmaclose(struct vma *v)
+{
+  if(v->f){
+    if(v->flags & MAP_SHARED)
+      imapshared(v->f->ip, -1);
+    fileclose(v->f);
+  }
+  v->addr = 0;
+  v->f = 0;
+}
+
+// Map len bytes of file f at offset off, or anonymous memory
+// if f is 0, into the current process.
+// Returns the address, or -1.
+uint64
+mmap(struct file *f, uint64 len, int prot, int flags, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 addr;
+
+  if(len == 0 || off % PGSIZE != 0)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(f){
+    if(f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+
+  len = PGROUNDUP(len);
+  addr = mmapbase(p);
+  if(len > addr || addr - len < PGROUNDUP(p->sz))
+    return -1;
+  addr -= len;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0){
+      if(f && (flags & MAP_SHARED) && imapshared(f->ip, 1) < 0)
+        return -1;  // a running program's file.
+      v->addr = addr;
+      v->len = len;
+      v->prot = prot;
+      v->flags = flags & (MAP_SHARED|MAP_PRIVATE);
+      v->f = f ? filedup(f) : 0;
+      v->off = off;
+      return addr;
+    }
+  }
+  return -1;
+}
+
+// Write the dirty pages of v from start to end back to v's
+// file, if v is a MAP_SHARED file mapping.  The pages are
+// mostly the page cache's own, so this just logs their blocks.
+static void
+writeback(pagetable_t pagetable, struct vma *v, uint64 start, uint64 end)
+{
+  uint64 va;
+  uint off, size;
+  int n;
+  pte_t *pte;
+
+  if(v->f == 0 || (v->flags & MAP_SHARED) == 0 || !v->f->writable)
+    return;
+  for(va = start; va < end; va += PGSIZE){
+    if((pte = walk(pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    if((*pte & PTE_D) == 0)
+      continue;
+    // write back only the part within the file.
+    off = v->off + (va - v->addr);
+    ilock(v->f->ip);
+    size = v->f->ip->size;
+    iunlock(v->f->ip);
+    if(off >= size)
+      continue;
+    n = size - off < PGSIZE ? size - off : PGSIZE;
+    filepwrite(v->f, 0, PTE2PA(*pte), n, off);
+  }
+}
+
+// Unmap the pages from addr to addr+len in the current
+// process, writing back dirty MAP_SHARED pages.  May leave
+// part of a mapping mapped, at either end or on both sides
+// of the hole.
+// Returns 0, or -1 on failure.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint64 start, end, vend;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    vend = v->addr + v->len;
+    start = addr > v->addr ? addr : v->addr;
+    end = addr + len < vend ? addr + len : vend;
+    if(start >= end)
+      continue;
+
+    nv = 0;
+    if(start > v->addr && end < vend){
+      // a hole in the middle: the part above needs a vma.
+      for(nv = p->vma; nv < &p->vma[NVMA]; nv++)
+        if(nv->addr == 0)
+          break;
+      if(nv == &p->vma[NVMA])
+        return -1;
+    }
+
+    writeback(p->pagetable, v, start, end);
+    uvmunmap(p->pagetable, start, (end - start) / PGSIZE, 1);
+
+    if(nv){
+      *nv = *v;
+      nv->addr = end;
+      nv->len = vend - end;
+      nv->off = v->off + (end - v->addr);
+      vmadup(nv);
+      v->len = start - v->addr;
+    } else if(start == v->addr && end == vend){
+      vmaclose(v);
+    } else if(start == v->addr){
+      v->off += end - v->addr;
+      v->addr = end;
+      v->len = vend - end;
+    } else {
+      v->len = start - v->addr;
+    }
+  }
+  return 0;
+}
+
+// Unmap all of p's mappings; for exit() and exec().
+void
+munmapall(struct proc *p)
+{
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    writeback(p->pagetable, v, v->addr, v->addr + v->len);
+    uvmunmap(p->pagetable, v->addr, v->len / PGSIZE, 1);
+    vmaclose(v);
+  }
+}
+
+// Page in all of p's MAP_SHARED pages, so that fork() can
+// share them: a page first touched after the fork would be
+// private to whichever process touched it.  Paging in can
+// sleep, so fork() calls this before it holds any locks.
+// Returns 0, or -1 on failure.
+int
+mmapfill(struct proc *p)
+{
+  uint64 va;
+
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0 || (v->flags & MAP_SHARED) == 0 || v->prot == PROT_NONE)
+      continue;
+    for(va = v->addr; va < v->addr + v->len; va += PGSIZE)
+      if(walkaddr(p->pagetable, va) == 0 && vmafault(p, va) != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// Give fork()'s child np the mappings of p, sharing the
+// pages of MAP_SHARED mappings, which mmapfill() has paged
+// in, and the pages of MAP_PRIVATE ones that p has touched.
+// Returns 0, or -1 with np left without mappings.
+int
+mmapcopy(struct proc *p, struct proc *np)
+{
+  struct vma *v, *nv;
+
+  for(v = p->vma, nv = np->vma; v < &p->vma[NVMA]; v++, nv++){
+    if(v->addr == 0)
+      continue;
+    if(uvmcopyrange(p->pagetable, np->pagetable, v->addr, v->addr + v->len,
+                    v->flags & MAP_SHARED) < 0)
+      goto bad;
+    *nv = *v;
+    vmadup(nv);
+  }
+  return 0;
+
+ bad:
+  for(nv = np->vma; nv < &np->vma[NVMA]; nv++){
+    if(nv->addr == 0)
+      continue;
+    uvmunmap(np->pagetable, nv->addr, nv->len / PGSIZE, 1);
+    vmaclose(nv);
+  }
+  return -1;
+}
+
+// Page in the page of a mapping of p that holds va: zeroed,
+// or from the mapped file.  A file page is the page cache's
+// own, mapped as it is for MAP_SHARED, and read-only or
+// copy-on-write for MAP_PRIVATE.
+// Reading may sleep and locks the file, so a caller holding a
+// spinlock or an inode lock gets a failure for file pages (see
+// uvmprefault()).
+// Returns 0 on success, -1 on failure, and 1 if va isn't in
+// a mapping.
+int
+vmafault(struct proc *p, uint64 va)
+{
+  struct vma *v;
+  struct inode *ip;
+  struct page *pg;
+  char *mem;
+  uint off;
+  int perm;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->addr && va >= v->addr && va < v->addr + v->len)
+      break;
+  if(v == &p->vma[NVMA])
+    return 1;
+
+  va = PGROUNDDOWN(va);
+  if(walkaddr(p->pagetable, va) != 0)
+    return -1;  // mapped; a protection fault.
+  if(v->prot == PROT_NONE)
+    return -1;
+  if(v->f && (!intr_get() || p->nilock > 0))
+    return -1;
+
+  // RISC-V has no write-only pages.
+  perm = PTE_U;
+  if(v->prot & (PROT_READ|PROT_WRITE))
+    perm |= PTE_R;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+
+  mem = 0;
+  if(v->f){
+    ip = v->f->ip;
+    off = v->off + (va - v->addr);
+    ilock(ip);
+    if(off < ip->size){
+      if((pg = ipage(ip, off / PGSIZE)) == 0){
+        iunlock(ip);
+        return -1;
+      }
+      mem = pg->data;
+      kref(mem);
+      if((v->flags & MAP_PRIVATE) && (perm & PTE_W))
+        perm = (perm & ~PTE_W) | PTE_COW;
+      prelse(pg);
+    }
+    iunlock(ip);
+  }
+  if(mem == 0){
+    // anonymous, or past the end of the file.
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+  }
+
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
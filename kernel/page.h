@@ -0,0 +1,12 @@
+// A page of file data in the page cache (pcache.c).
+struct page {
+  uint dev;
+  uint inum;
+  uint pgno;          // file offset / PGSIZE
+  int valid;          // has data been read from disk?
+  int ref;            // users between pget() and prelse()
+  char *data;         // PGSIZE bytes from kalloc()
+  struct page *next;  // hash chain, or free list
+  struct page *lprev; // LRU list
+  struct page *lnext;
+};
@@ -6,8 +6,18 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define PIPEPAGES     1  // buffer pages per pipe; a power of 2
+#define NVMA         16  // memory mappings per process
+#define NEXECSEG      4  // demand-paged ELF segments per process
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in each on-disk log region
+#define NBUF         (MAXOPBLOCKS*12) // size of disk block cache
+#define FSSIZE       200000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TIMEFREQ  10000000 // time CSR units per second on qemu virt
+#define TICKINTERVAL (TIMEFREQ/10) // time CSR units per tick
+#define PROFINTERVAL (TIMEFREQ/1000) // time CSR units between profiler samples
+#define NPROFSAMPLE 1024 // profiler samples buffered per CPU
+#define NMLFQ         3  // MLFQ scheduler priority levels
+#define QUANTUM       1  // timer ticks in a top-priority MLFQ time slice
+#define BOOSTTICKS   50  // ticks between MLFQ priority boosts
@@ -0,0 +1,313 @@
+// Page cache.
+//
+// The page cache holds file contents in whole pages, keyed by
+// (dev, inum, page number), so that reading and writing files
+// doesn't push inode, bitmap and directory blocks out of the
+// much smaller buffer cache.  readi() and writei() in fs.c do
+// their copies to and from cached pages.
+//
+// The page cache has no fixed size.  It takes pages from
+// kalloc() while more than pcache.reserve pages are free, and
+// after that recycles its least recently used page; if kalloc()
+// runs out of memory, it takes pages back with pcachereclaim().
+//
+// exec() and mmap() map cached pages into processes, with a
+// kref() on the data, rather than keeping copies of their own.
+// A mapped page is not evicted, since that would free nothing.
+// Before a write changes it, punshare() moves the cache to a
+// copy so that the processes keep what they mapped, unless the
+// file has MAP_SHARED mappings: those must see the write, so
+// writei() changes the page in place.  Then read() sees stores
+// to a shared mapping and the mapping sees write()s, and the
+// MAP_PRIVATE mappings of the page see them too until they
+// copy it.  A program's text never changes this way, since a
+// file being run can't be mapped shared (see iexec()).
+//
+// Interface:
+// * To get a page of a file, call pget() while holding the
+//     inode's lock.  If the page isn't valid, fill it.
+// * When done with the page, call prelse().
+// * The contents of a file's pages are protected by its inode's
+//     lock; pcache.lock protects only the hash table, LRU list
+//     and reference counts.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "page.h"
+
+#define NPHASH 61
+
+// Pages taken back from the cache by one pcachereclaim().
+#define NRECLAIM 32
+
+struct {
+  struct spinlock lock;
+  struct page *hash[NPHASH];
+  struct page lru;       // lru.lnext is most recently used
+  struct page *free;     // unused page descriptors
+  int n;                 // pages cached
+  int reserve;           // free pages to leave to kalloc() users
+
+  // statistics.
+  int hit;
+  int miss;
+  int evict;
+} pcache;
+
+static int
+phash(uint dev, uint inum, uint pgno)
+{
+  return (dev * 31 + inum * 17 + pgno) % NPHASH;
+}
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.lru.lnext = &pcache.lru;
+  pcache.lru.lprev = &pcache.lru;
+  pcache.reserve = kfreepages() / 8;
+}
+
+// Unlink pg from the LRU list.
+static void
+lruremove(struct page *pg)
+{
+  pg->lprev->lnext = pg->lnext;
+  pg->lnext->lprev = pg->lprev;
+}
+
+// Link pg at the most recently used end of the LRU list.
+static void
+lrufront(struct page *pg)
+{
+  pg->lnext = pcache.lru.lnext;
+  pg->lprev = &pcache.lru;
+  pcache.lru.lnext->lprev = pg;
+  pcache.lru.lnext = pg;
+}
+
+// Unlink pg from its hash chain and the LRU list.
+// Caller must hold pcache.lock.
+static void
+punlink(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = &pcache.hash[phash(pg->dev, pg->inum, pg->pgno)]; *pp != pg; pp = &(*pp)->next)
+    ;
+  *pp = pg->next;
+  lruremove(pg);
+  pcache.n--;
+}
+
+// Remove the least recently used page that is neither
+// referenced nor mapped from the cache and return it, or
+// return 0 if every page is in use.
+// Caller must hold pcache.lock.
+static struct page*
+pevict(void)
+{
+  struct page *pg;
+
+  for(pg = pcache.lru.lprev; pg != &pcache.lru; pg = pg->lprev){
+    if(pg->ref == 0 && krefcount(pg->data) == 1){
+      punlink(pg);
+      pcache.evict++;
+      return pg;
+    }
+  }
+  return 0;
+}
+
+// Return an unused page descriptor, or 0.
+// Descriptors come from kalloc() a page at a time and are
+// never given back.
+static struct page*
+pdesc(void)
+{
+  struct page *pg;
+  char *mem;
+  int i;
+
+  acquire(&pcache.lock);
+  if(pcache.free == 0){
+    release(&pcache.lock);
+    if((mem = kalloc()) == 0)
+      return 0;
+    acquire(&pcache.lock);
+    for(i = 0; i < PGSIZE / sizeof(struct page); i++){
+      pg = (struct page*)mem + i;
+      pg->next = pcache.free;
+      pcache.free = pg;
+    }
+  }
+  pg = pcache.free;
+  pcache.free = pg->next;
+  release(&pcache.lock);
+  return pg;
+}
+
+// Return a referenced page of ip's file at page number pgno,
+// not yet valid if it wasn't cached.
+// Returns 0 if there is no memory for the page.
+// Caller must hold ip->lock.
+struct page*
+pget(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+  char *mem;
+  int h;
+
+  if(!holdingsleep(&ip->lock))
+    panic("pget");
+
+  h = phash(ip->dev, ip->inum, pgno);
+  acquire(&pcache.lock);
+  for(pg = pcache.hash[h]; pg; pg = pg->next){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->pgno == pgno){
+      pg->ref++;
+      lruremove(pg);
+      lrufront(pg);
+      pcache.hit++;
+      release(&pcache.lock);
+      return pg;
+    }
+  }
+  pcache.miss++;
+
+  // Grow the cache while there is plenty of free memory,
+  // and otherwise recycle a page.  Only the holder of
+  // ip->lock adds pages of ip, so no other process can
+  // add this page while pcache.lock isn't held.
+  pg = 0;
+  mem = 0;
+  if(kfreepages() <= pcache.reserve)
+    pg = pevict();
+  release(&pcache.lock);
+
+  if(pg == 0){
+    if((mem = kalloc()) == 0)
+      return 0;
+    if((pg = pdesc()) == 0){
+      kfree(mem);
+      return 0;
+    }
+    pg->data = mem;
+  }
+
+  pg->dev = ip->dev;
+  pg->inum = ip->inum;
+  pg->pgno = pgno;
+  pg->valid = 0;
+  pg->ref = 1;
+  acquire(&pcache.lock);
+  pg->next = pcache.hash[h];
+  pcache.hash[h] = pg;
+  lrufront(pg);
+  pcache.n++;
+  release(&pcache.lock);
+  return pg;
+}
+
+// Drop a reference from pget().
+void
+prelse(struct page *pg)
+{
+  acquire(&pcache.lock);
+  if(pg->ref < 1)
+    panic("prelse");
+  pg->ref--;
+  release(&pcache.lock);
+}
+
+// Make pg, which the caller is about to change, private to
+// the cache: if processes have its data mapped, give the
+// cache a copy and leave them the old contents.
+// Returns 0, or -1 if there is no memory for the copy.
+// Caller must hold the inode's lock and a reference to pg.
+int
+punshare(struct page *pg)
+{
+  char *mem;
+
+  if(krefcount(pg->data) == 1)
+    return 0;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, pg->data, PGSIZE);
+  kfree(pg->data);
+  pg->data = mem;
+  return 0;
+}
+
+// Discard the cached pages of ip, whose contents are being
+// freed.  Processes that have them mapped keep them.
+// Caller must hold ip->lock.
+void
+pinval(struct inode *ip)
+{
+  struct page *pg, *next, *freed = 0;
+
+  acquire(&pcache.lock);
+  for(int h = 0; h < NPHASH; h++){
+    for(pg = pcache.hash[h]; pg; pg = next){
+      next = pg->next;
+      if(pg->dev != ip->dev || pg->inum != ip->inum)
+        continue;
+      if(pg->ref)
+        panic("pinval");
+      punlink(pg);
+      pg->next = freed;
+      freed = pg;
+    }
+  }
+  release(&pcache.lock);
+
+  for(pg = freed; pg; pg = next){
+    next = pg->next;
+    kfree(pg->data);
+    acquire(&pcache.lock);
+    pg->next = pcache.free;
+    pcache.free = pg;
+    release(&pcache.lock);
+  }
+}
+
+// Give up to NRECLAIM unreferenced pages back to kalloc().
+// Called by kalloc() when it runs out of memory.
+// Returns the number of pages freed.
+int
+pcachereclaim(void)
+{
+  struct page *pg;
+  char *mem[NRECLAIM];
+  int n;
+
+  acquire(&pcache.lock);
+  for(n = 0; n < NRECLAIM && (pg = pevict()) != 0; n++){
+    mem[n] = pg->data;
+    pg->next = pcache.free;
+    pcache.free = pg;
+  }
+  release(&pcache.lock);
+
+  for(int i = 0; i < n; i++)
+    kfree(mem[i]);
+  return n;
+}
+
+// Print page cache statistics.  For debugging.
+// Called from procdump(); no locks, like procdump.
+void
+pcachedump(void)
+{
+  printf("pcache: pages %d free %d reserve %d, hits %d misses %d evictions %d\n",
+         pcache.n, kfreepages(), pcache.reserve, pcache.hit, pcache.miss, pcache.evict);
+}
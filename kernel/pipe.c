@@ -8,17 +8,39 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// The buffer is PIPEPAGES separate pages, used as a ring.
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
+// A pipe's buffer is written by one writer at a time and read
+// by one reader at a time, serialized by wlock and rlock.  The
+// writer fills only the free part of the ring and the reader
+// empties only the full part, so both copy to and from user
+// space without holding lock, which covers just nread and
+// nwrite, and sleep()/wakeup().  Copying without a spinlock
+// also lets the copy page in the program (see execfault()).
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  struct sleeplock rlock; // held by the reader
+  struct sleeplock wlock; // held by the writer
+  char *data[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static void
+pipefree(struct pipe *pi)
+{
+  freelock(&pi->lock);
+  freesleeplock(&pi->rlock);
+  freesleeplock(&pi->wlock);
+  for(int i = 0; i < PIPEPAGES; i++)
+    if(pi->data[i])
+      kfree(pi->data[i]);
+  kfree((char*)pi);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,11 +52,18 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  initlock(&pi->lock, "pipe");
+  initsleeplock(&pi->rlock, "piperead");
+  initsleeplock(&pi->wlock, "pipewrite");
+  for(int i = 0; i < PIPEPAGES; i++)
+    pi->data[i] = 0;
+  for(int i = 0; i < PIPEPAGES; i++)
+    if((pi->data[i] = kalloc()) == 0)
+      goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
-  initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -47,7 +76,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,60 +97,149 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
 
-int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+// Put up to n bytes into pi: from file f if f isn't 0, else
+// from addr, a user virtual address if user_src==1 and a kernel
+// address otherwise.  Stops early if f has no more to give.
+static int
+pipefill(struct pipe *pi, struct file *f, int user_src, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  int i, m, c, err;
+  uint w;
+  char *dst;
   struct proc *pr = myproc();
 
+  err = 0;
+  acquiresleep(&pi->wlock);
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(pi->readopen == 0 || pr->killed){
-        release(&pi->lock);
-        return -1;
-      }
-      wakeup(&pi->nread);
+  for(i = 0; i < n; ){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      releasesleep(&pi->wlock);
+      return -1;
+    }
+    if(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
       sleep(&pi->nwrite, &pi->lock);
+      continue;
+    }
+
+    // Copy the longest span that is free and contiguous.
+    w = pi->nwrite;
+    m = n - i;
+    if(m > pi->nread + PIPESIZE - w)
+      m = pi->nread + PIPESIZE - w;
+    if(m > PGSIZE - w % PGSIZE)
+      m = PGSIZE - w % PGSIZE;
+    dst = pi->data[(w / PGSIZE) % PIPEPAGES] + w % PGSIZE;
+    release(&pi->lock);
+    if(f)
+      c = fileread(f, 0, (uint64)dst, m);
+    else
+      c = either_copyin(dst, user_src, addr + i, m) == -1 ? -1 : m;
+    acquire(&pi->lock);
+    if(c <= 0){
+      err = c < 0;
+      break;
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+
+    // Only a reader of an empty pipe can be asleep.
+    if(pi->nwrite == pi->nread)
+      wakeup(&pi->nread);
+    pi->nwrite += c;
+    i += c;
+    if(c < m)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
   }
-  wakeup(&pi->nread);
   release(&pi->lock);
+  releasesleep(&pi->wlock);
+  if(i == 0 && err)
+    return -1;
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n)
+{
+  return pipefill(pi, 0, user_src, addr, n);
+}
+
+// Move up to n bytes from file f into pi, reading them
+// straight into the pipe's buffer.
+int
+pipesplicein(struct pipe *pi, struct file *f, int n)
 {
-  int i;
+  return pipefill(pi, f, 0, 0, n);
+}
+
+// Take up to n bytes out of pi: to file f if f isn't 0, else
+// to addr, a user virtual address if user_dst==1 and a kernel
+// address otherwise.  Waits only while pi is empty.
+static int
+pipedrain(struct pipe *pi, struct file *f, int user_dst, uint64 addr, int n)
+{
+  int i, m, c;
+  uint r;
+  char *src;
   struct proc *pr = myproc();
-  char ch;
 
+  acquiresleep(&pi->rlock);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){
       release(&pi->lock);
+      releasesleep(&pi->rlock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
+  for(i = 0; i < n && pi->nread != pi->nwrite; ){  //DOC: piperead-copy
+    // Copy the longest span that is full and contiguous.
+    r = pi->nread;
+    m = n - i;
+    if(m > pi->nwrite - r)
+      m = pi->nwrite - r;
+    if(m > PGSIZE - r % PGSIZE)
+      m = PGSIZE - r % PGSIZE;
+    src = pi->data[(r / PGSIZE) % PIPEPAGES] + r % PGSIZE;
+    release(&pi->lock);
+    if(f)
+      c = filewrite(f, 0, (uint64)src, m);
+    else
+      c = either_copyout(user_dst, addr + i, src, m) == -1 ? -1 : m;
+    acquire(&pi->lock);
+    if(c <= 0){
+      if(i == 0)
+        i = -1;
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    }
+
+    // Only a writer to a full pipe can be asleep.
+    if(pi->nwrite == pi->nread + PIPESIZE)
+      wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+    pi->nread += c;
+    i += c;
+    if(c < m)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
+  releasesleep(&pi->rlock);
   return i;
 }
+
+int
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n)
+{
+  return pipedrain(pi, 0, user_dst, addr, n);
+}
+
+// Move up to n bytes from pi to file f, writing them
+// straight from the pipe's buffer.
+int
+pipespliceout(struct pipe *pi, struct file *f, int n)
+{
+  return pipedrain(pi, f, 0, 0, n);
+}
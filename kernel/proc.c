@@ -12,10 +12,67 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
+// Per-CPU queues of RUNNABLE processes, so that scheduler()
+// picks the next process in O(1) and CPUs don't contend for
+// each other's locks.  A process is on at most one queue, and
+// only while RUNNABLE.  An idle CPU steals from the longest
+// queue.  To avoid deadlock, a queue's lock is never held
+// while acquiring a p->lock.
+//
+// Each queue has NMLFQ levels.  Under SCHED_RR every process
+// stays at level 0 and is preempted on every timer tick.
+// Under SCHED_MLFQ a process that uses up its time slice
+// drops a level and gets a slice twice as long; a process
+// that wakes from sleep() goes back to level 0, so that
+// interactive processes run ahead of CPU-bound ones; and
+// every BOOSTTICKS all queued processes go back to level 0,
+// so that none starves.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NMLFQ];
+  struct proc *tail[NMLFQ];
+  uint boosted; // ticks at the last priority boost
+  int n;        // processes on the queue
+  int nswitch;  // processes run from this queue
+  int nsteal;   // processes stolen by this CPU
+} runq[NCPU];
+
+// Chosen at build time, e.g. make SCHED=mlfq.
+#ifndef SCHEDPOLICY
+#define SCHEDPOLICY SCHED_RR
+#endif
+int schedpolicy = SCHEDPOLICY;
+
+// Histogram of how long processes wait on a run queue:
+// schedlat[i] counts waits of less than 2^(i+1) microseconds
+// (but at least 2^i, for i > 0).  The last bucket also holds
+// all longer waits.
+#define NLATBUCKET 16
+int schedlat[NLATBUCKET];
+
+// Processes in sleep(), hashed by channel, so that wakeup()
+// looks only at the processes sleeping on channels that hash
+// to the same queue.  Lock order: p->lock, then a queue's lock.
+#define NSLEEPQ 61
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+  int nwakeup;  // calls to wakeup()
+  int nscan;    // sleepers examined by wakeup()
+  int nhit;     // sleepers woken by wakeup()
+} sleepq[NSLEEPQ];
+
+#define SLEEPQ(chan) (&sleepq[((uint64)(chan) >> 3) % NSLEEPQ])
+
+// Sleepers that wakeup() collects per scan of a queue.
+#define WAKEBATCH 8
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
 
@@ -28,6 +85,10 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
 
@@ -73,6 +134,146 @@ myproc(void) {
   return p;
 }
 
+// Mark p RUNNABLE and append it to the run queue of the
+// current CPU, which is likely to switch to it soon and may
+// have the data it shares with the waker in its cache.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq;
+  int lvl;
+
+  if(!holding(&p->lock))
+    panic("setrunnable");
+  p->state = RUNNABLE;
+  p->cpu = cpuid();
+  p->readytime = r_time();
+  rq = &runq[p->cpu];
+  lvl = p->priority;
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail[lvl])
+    rq->tail[lvl]->rqnext = p;
+  else
+    rq->head[lvl] = p;
+  rq->tail[lvl] = p;
+  rq->n++;
+  release(&rq->lock);
+
+  // If p has to wait behind another process here, queued or
+  // running, let an idle CPU steal one of them.
+  __sync_synchronize();
+  if(mycpu()->proc != 0 || rq->n > 1)
+    kickidle();
+}
+
+// Wake p, which is SLEEPING: take it off its sleep queue
+// and make it RUNNABLE.  Caller must hold p->lock.
+static void
+wakeproc(struct proc *p)
+{
+  struct sleepq *sq = SLEEPQ(p->chan);
+  struct proc **pp;
+
+  acquire(&sq->lock);
+  for(pp = &sq->head; *pp; pp = &(*pp)->sqnext){
+    if(*pp == p){
+      *pp = p->sqnext;
+      break;
+    }
+  }
+  release(&sq->lock);
+  p->sqnext = 0;
+  // boost a process that waited for I/O or another event.
+  p->priority = 0;
+  p->sliceticks = 0;
+  setrunnable(p);
+}
+
+// Move every process on rq to level 0.
+// Caller must hold rq->lock.
+static void
+runqboost(struct runq *rq)
+{
+  struct proc *p;
+
+  for(int lvl = 1; lvl < NMLFQ; lvl++){
+    if(rq->head[lvl] == 0)
+      continue;
+    for(p = rq->head[lvl]; p; p = p->rqnext){
+      p->priority = 0;
+      p->sliceticks = 0;
+    }
+    if(rq->tail[0])
+      rq->tail[0]->rqnext = rq->head[lvl];
+    else
+      rq->head[0] = rq->head[lvl];
+    rq->tail[0] = rq->tail[lvl];
+    rq->head[lvl] = rq->tail[lvl] = 0;
+  }
+  rq->boosted = ticks;
+}
+
+// Take the first process off the highest non-empty level of
+// run queue id, or return 0.
+static struct proc*
+runqget(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p = 0;
+
+  acquire(&rq->lock);
+  if(ticks - rq->boosted >= BOOSTTICKS)
+    runqboost(rq);
+  for(int lvl = 0; lvl < NMLFQ; lvl++){
+    if((p = rq->head[lvl]) != 0){
+      rq->head[lvl] = p->rqnext;
+      if(rq->head[lvl] == 0)
+        rq->tail[lvl] = 0;
+      p->rqnext = 0;
+      rq->n--;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Return the number of processes on all run queues.
+// Reads the queues without their locks, as a hint.
+static int
+runqlen(void)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    n += runq[i].n;
+  return n;
+}
+
+// Steal a process for idle CPU id from the longest other
+// run queue.  The lengths are read without locks, as a hint.
+static struct proc*
+runqsteal(int id)
+{
+  struct proc *p;
+  int i, victim, n;
+
+  victim = -1;
+  n = 0;
+  for(i = 0; i < NCPU; i++){
+    if(i != id && runq[i].n > n){
+      victim = i;
+      n = runq[i].n;
+    }
+  }
+  if(victim < 0 || (p = runqget(victim)) == 0)
+    return 0;
+  runq[id].nsteal++;
+  return p;
+}
+
 int
 allocpid() {
   int pid;
@@ -106,6 +307,8 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->priority = 0;
+  p->sliceticks = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -113,6 +316,18 @@ found:
     return 0;
   }
 
+  // Allocate the page that user code reads getpid() and
+  // uptime() from.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
+  p->usyscall->tickinterval = TICKINTERVAL;
+  p->usyscall->timefreq = TIMEFREQ;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -139,6 +354,10 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
+  ringfree(p);
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -149,6 +368,10 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kthread = 0;
+  p->execip = 0;
+  p->nseg = 0;
+  p->tracemask = 0;
   p->state = UNUSED;
 }
 
@@ -182,6 +405,16 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the usyscall page just below TRAPFRAME, read-only
+  // to user code.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -192,6 +425,8 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  uvmunmap(pagetable, URING, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -228,25 +463,29 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growth is lazy: it only raises p->sz, and usertrap()
+// allocates each page the first time it is touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n > mmapbase(p))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
+    if(-(uint64)n > sz)
+      return -1;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
@@ -262,6 +501,10 @@ fork(void)
   struct proc *np;
   struct proc *p = myproc();
 
+  // Page in the pages the child will share, before taking locks.
+  if(mmapfill(p) < 0)
+    return -1;
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -274,6 +517,11 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  if(mmapcopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   np->parent = p;
 
@@ -288,18 +536,51 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->execip){
+    // p's count of the program keeps it from being mapped shared.
+    if(iexec(p->execip, 1) < 0)
+      panic("fork: iexec");
+    np->execip = idup(p->execip);
+  }
+  np->nseg = p->nseg;
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->tracemask = p->tracemask;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  setrunnable(np);
 
   release(&np->lock);
 
   return pid;
 }
 
+// Create a kernel thread: a process with no user memory
+// that runs fn() in the kernel, so that fn can sleep.
+// fn must never return.
+// Returns the thread's pid, or -1 on failure.
+int
+kthread(void (*fn)(void), char *name)
+{
+  int pid;
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    return -1;
+
+  p->kthread = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+  setrunnable(p);
+
+  release(&p->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -337,6 +618,9 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Write back and drop mapped files before closing them.
+  munmapall(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -348,8 +632,13 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->execip){
+    iexec(p->execip, -1);
+    iput(p->execip);
+  }
   end_op();
   p->cwd = 0;
+  p->execip = 0;
 
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
@@ -401,6 +690,12 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // page in addr now: the status is copied out under p->lock,
+  // where paging in from a file isn't allowed, and the child
+  // must stay unreaped if the copy fails.
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int));
+
   // hold p->lock for the whole time to avoid lost
   // wakeups from a child's exit().
   acquire(&p->lock);
@@ -446,6 +741,19 @@ wait(uint64 addr)
   }
 }
 
+// Record in schedlat[] that a process waited t
+// time CSR units on a run queue.
+static void
+schedwait(uint64 t)
+{
+  int i;
+
+  t /= TIMEFREQ / 1000000;
+  for(i = 0; t > 1 && i < NLATBUCKET-1; i++)
+    t >>= 1;
+  __sync_fetch_and_add(&schedlat[i], 1);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -458,35 +766,51 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = c - cpus;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-
-        found = 1;
+
+    if((p = runqget(id)) == 0 && (p = runqsteal(id)) == 0){
+      // Nothing to run.  Wait in wfi, with the timer set only
+      // for the next timer deadline.  Say we're idle
+      // before looking at the queues again, so that a process
+      // queued meanwhile comes with a kickidle().
+      intr_off();
+      c->idle = 1;
+      __sync_synchronize();
+      if(runqlen() == 0){
+        clockset();
+        asm volatile("wfi");
       }
-      release(&p->lock);
-    }
-    if(found == 0) {
-      intr_on();
-      asm volatile("wfi");
+      c->idle = 0;
+      continue;
     }
+
+    // p may still be switching out on the CPU that made it
+    // RUNNABLE; acquiring p->lock waits until it's done.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    c->proc = p;
+    runq[id].nswitch++;
+    schedwait(r_time() - p->readytime);
+    if(c->timer > r_time() + TICKINTERVAL)
+      clockset();  // was idle; time p's slice.
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -523,11 +847,42 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
 
+// Called on each timer interrupt while a process runs.
+// Returns 1 if the process should yield() the CPU.
+int
+timeslice(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq;
+  int lvl, r;
+
+  if(schedpolicy == SCHED_RR)
+    return 1;
+
+  if(++p->sliceticks >= (QUANTUM << p->priority)){
+    if(p->priority < NMLFQ-1)
+      p->priority++;
+    p->sliceticks = 0;
+    return 1;
+  }
+
+  // Preempt p for a higher-priority process on this CPU's
+  // run queue.  Reads the queue without its lock, as a hint.
+  r = 0;
+  push_off();
+  rq = &runq[cpuid()];
+  for(lvl = 0; lvl < p->priority; lvl++)
+    if(rq->head[lvl])
+      r = 1;
+  pop_off();
+  return r;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -549,26 +904,47 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kthread();
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // Once we hold p->lock and are on chan's
+  // sleep queue, we can be guaranteed that
+  // we won't miss any wakeup (wakeup finds us
+  // there and then locks p->lock),
   // so it's okay to release lk.
-  if(lk != &p->lock){  //DOC: sleeplock0
+  if(lk != &p->lock)  //DOC: sleeplock0
     acquire(&p->lock);  //DOC: sleeplock1
+  p->chan = chan;
+  sq = SLEEPQ(chan);
+  acquire(&sq->lock);
+  p->sqnext = sq->head;
+  sq->head = p;
+  release(&sq->lock);
+  if(lk != &p->lock)
     release(lk);
-  }
 
   // Go to sleep.
-  p->chan = chan;
   p->state = SLEEPING;
 
   sched();
@@ -588,15 +964,37 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct sleepq *sq = SLEEPQ(chan);
+  struct proc *p, *sleepers[WAKEBATCH];
+  int i, n;
+
+  // Find the sleepers under the queue's lock, then wake them
+  // under their own locks, to keep the lock order.  Only a
+  // few at a time, to stay light on the kernel stack: waking
+  // takes them off the queue, so scan again after a full batch.
+  acquire(&sq->lock);
+  sq->nwakeup++;
+  release(&sq->lock);
+  do {
+    n = 0;
+    acquire(&sq->lock);
+    for(p = sq->head; p && n < WAKEBATCH; p = p->sqnext){
+      sq->nscan++;
+      if(p->chan == chan)
+        sleepers[n++] = p;
+    }
+    release(&sq->lock);
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
+    for(i = 0; i < n; i++){
+      p = sleepers[i];
+      acquire(&p->lock);
+      if(p->state == SLEEPING && p->chan == chan) {
+        wakeproc(p);
+        __sync_fetch_and_add(&sq->nhit, 1);
+      }
+      release(&p->lock);
     }
-    release(&p->lock);
-  }
+  } while(n == WAKEBATCH);
 }
 
 // Wake up p if it is sleeping in wait(); used by exit().
@@ -607,7 +1005,7 @@ wakeup1(struct proc *p)
   if(!holding(&p->lock))
     panic("wakeup1");
   if(p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
+    wakeproc(p);
   }
 }
 
@@ -625,7 +1023,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        wakeproc(p);
       }
       release(&p->lock);
       return 0;
@@ -692,4 +1090,25 @@ procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
+  for(int i = 0; i < NCPU; i++){
+    if(runq[i].nswitch == 0)
+      continue;
+    printf("runq cpu %d: len %d switches %d steals %d\n",
+           i, runq[i].n, runq[i].nswitch, runq[i].nsteal);
+  }
+  printf("sched %s latency (us):", schedpolicy == SCHED_MLFQ ? "mlfq" : "rr");
+  for(int i = 0; i < NLATBUCKET; i++)
+    if(schedlat[i])
+      printf(" <%d:%d", 2 << i, schedlat[i]);
+  printf("\n");
+  int nwakeup = 0, nscan = 0, nhit = 0;
+  for(int i = 0; i < NSLEEPQ; i++){
+    nwakeup += sleepq[i].nwakeup;
+    nscan += sleepq[i].nscan;
+    nhit += sleepq[i].nhit;
+  }
+  printf("wakeup: calls %d scanned %d woken %d\n", nwakeup, nscan, nhit);
+  kmemdump();
+  bcachedump();
+  pcachedump();
 }
@@ -24,10 +24,17 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In scheduler()'s wfi, with nothing to run?
+  uint64 timer;               // Next timer interrupt, in time CSR units.
+  uint64 tick;                // Next scheduling tick, while running a process.
 };
 
 extern struct cpu cpus[NCPU];
 
+// Scheduling policies; see schedpolicy in proc.c.
+#define SCHED_RR   0  // round robin, one tick time slices
+#define SCHED_MLFQ 1  // multi-level feedback queue
+
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
 // user page table. not specially mapped in the kernel page table.
@@ -80,6 +87,26 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A memory mapping made by mmap(); see mmap.c.
+struct vma {
+  uint64 addr;                 // Start, page-aligned; 0 if unused
+  uint64 len;                  // Length in bytes, page-aligned
+  int prot;                    // PROT_READ, PROT_WRITE, PROT_EXEC
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // Mapped file, or 0 if anonymous
+  uint off;                    // File offset of addr
+};
+
+// An ELF segment that exec() left to be paged in on demand
+// from the executable; see execfault().
+struct execseg {
+  uint64 va;                   // Page-aligned start
+  uint64 memsz;                // Bytes in memory
+  uint64 filesz;               // Bytes backed by the file
+  uint off;                    // Offset of the segment in the file
+  int perm;                    // PTE_R, PTE_W, PTE_X
+};
+
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -93,14 +120,31 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // CPU whose run queue p goes on
+  int priority;                // MLFQ level; 0 is the highest
+  int sliceticks;              // Timer ticks used of the time slice
+  uint64 readytime;            // time CSR when p became RUNNABLE
+
+  // the run queue's or sleep queue's lock must be held when using these:
+  struct proc *rqnext;         // Next process on the run queue
+  struct proc *sqnext;         // Next process on the sleep queue
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct usyscall *usyscall;   // read-only page for ulib.c
+  struct ring *ring;           // submission/completion ring, or 0
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *execip;        // Executable, for demand paging
+  int nilock;                  // Inode locks held, by ilock()
+  int nseg;                    // Entries used in seg[]
+  struct execseg seg[NEXECSEG]; // Demand-paged segments
+  struct vma vma[NVMA];        // Memory mappings
+  uint64 tracemask;            // System calls to trace, 1<<SYS_xxx
   char name[16];               // Process name (debugging)
+  void (*kthread)(void);       // If non-zero, kernel thread body
 };
@@ -0,0 +1,111 @@
+// Sampling profiler.
+//
+// While profiling is on, each CPU running a process takes a
+// timer interrupt every PROFINTERVAL (see clockset()), and
+// devintr() records the interrupted pc, user or kernel, in
+// that CPU's ring of samples.  profread() drains the rings;
+// samples taken while a ring is full are counted and dropped.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "prof.h"
+
+// Samples copied out by profread() per acquire.
+#define PROFBATCH 16
+
+int profiling;
+
+struct {
+  struct spinlock lock;
+  struct profsample buf[NPROFSAMPLE];
+  uint r;     // samples read
+  uint w;     // samples written
+  int ndrop;  // samples dropped because buf was full
+} profbuf[NCPU];
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profbuf[i].lock, "prof");
+}
+
+// Record a sample of pc, interrupted in user space if user
+// is set.  Called from devintr() with interrupts off.
+void
+profsample(uint64 pc, int user)
+{
+  struct proc *p = myproc();
+  struct profsample *s;
+  int id = cpuid();
+
+  acquire(&profbuf[id].lock);
+  if(profbuf[id].w - profbuf[id].r == NPROFSAMPLE){
+    profbuf[id].ndrop++;
+  } else {
+    s = &profbuf[id].buf[profbuf[id].w++ % NPROFSAMPLE];
+    s->pc = pc;
+    s->pid = p ? p->pid : 0;
+    s->inum = user && p && p->execip ? p->execip->inum : 0;
+  }
+  release(&profbuf[id].lock);
+}
+
+// Discard old samples and start profiling.
+void
+profstart(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    acquire(&profbuf[i].lock);
+    profbuf[i].r = profbuf[i].w = 0;
+    profbuf[i].ndrop = 0;
+    release(&profbuf[i].lock);
+  }
+  profiling = 1;
+}
+
+// Stop profiling.
+// Returns the number of samples dropped since profstart().
+int
+profstop(void)
+{
+  int n = 0;
+
+  profiling = 0;
+  for(int i = 0; i < NCPU; i++)
+    n += profbuf[i].ndrop;
+  return n;
+}
+
+// Copy out up to n samples, from all CPUs, to the array of
+// struct profsample at user address addr.
+// Returns the number copied, or -1.
+int
+profread(uint64 addr, int n)
+{
+  struct profsample batch[PROFBATCH];
+  int i, m, tot = 0;
+
+  for(i = 0; i < NCPU; i++){
+    do {
+      // copyout() may fault, so not while holding the lock.
+      acquire(&profbuf[i].lock);
+      for(m = 0; m < PROFBATCH && tot + m < n && profbuf[i].r != profbuf[i].w; m++)
+        batch[m] = profbuf[i].buf[profbuf[i].r++ % NPROFSAMPLE];
+      release(&profbuf[i].lock);
+      if(m > 0 && copyout(myproc()->pagetable, addr + tot*sizeof(batch[0]),
+                          (char*)batch, m*sizeof(batch[0])) < 0)
+        return -1;
+      tot += m;
+    } while(m > 0);
+  }
+  return tot;
+}
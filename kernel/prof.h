@@ -0,0 +1,8 @@
+// A sample taken by the profiler (prof.c), as returned by
+// profread().
+struct profsample {
+  uint64 pc;    // interrupted program counter, user or kernel
+  int pid;      // interrupted process, or 0 if none
+  uint inum;    // for a user pc, inode number of the process's
+                // executable; 0 for a kernel pc
+};
@@ -0,0 +1,101 @@
+// Submission/completion rings for batched system calls.
+//
+// ringsetup() gives a process a page, mapped at URING, that it
+// shares with the kernel.  The process queues read, write, close
+// and fstat operations on its submission queue, and a single
+// ringenter() carries out many of them, in order, posting each
+// result on the completion queue.  The kernel uses the page
+// through p->ring; it copies each submission before acting on it,
+// since the process can write anything to the page.
+// A ring is not inherited by fork() and is dropped by exec().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "ring.h"
+
+// Give the current process a ring, if it has none.
+// Returns its user address, or -1.
+uint64
+ringsetup(void)
+{
+  struct proc *p = myproc();
+  char *mem;
+
+  if(p->ring)
+    return URING;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)mem, PTE_R | PTE_W | PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  p->ring = (struct ring*)mem;
+  return URING;
+}
+
+// Free p's ring page, which its page table no longer maps.
+void
+ringfree(struct proc *p)
+{
+  if(p->ring)
+    kfree((void*)p->ring);
+  p->ring = 0;
+}
+
+// Carry out one submission.
+static int
+ringop(struct proc *p, struct sqe *e)
+{
+  struct file *f;
+
+  if(e->fd < 0 || e->fd >= NOFILE || (f = p->ofile[e->fd]) == 0)
+    return -1;
+  if((int)e->len < 0)
+    return -1;
+  switch(e->op){
+  case RING_READ:
+    return fileread(f, 1, e->addr, e->len);
+  case RING_WRITE:
+    return filewrite(f, 1, e->addr, e->len);
+  case RING_FSTAT:
+    return filestat(f, e->addr);
+  case RING_CLOSE:
+    p->ofile[e->fd] = 0;
+    fileclose(f);
+    return 0;
+  }
+  return -1;
+}
+
+// Carry out up to n queued submissions, stopping early if the
+// completion queue fills.
+// Returns the number carried out, or -1 if there is no ring.
+int
+ringenter(int n)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->ring;
+  struct sqe e;
+  struct cqe *c;
+  int done;
+
+  if(r == 0)
+    return -1;
+  for(done = 0; done < n && r->sqhead != r->sqtail; done++){
+    if(r->cqtail - r->cqhead >= RING_ENTRIES || p->killed)
+      break;
+    e = r->sq[r->sqhead % RING_ENTRIES];
+    r->sqhead++;
+    c = &r->cq[r->cqtail % RING_ENTRIES];
+    c->data = e.data;
+    c->res = ringop(p, &e);
+    r->cqtail++;
+  }
+  return done;
+}
@@ -0,0 +1,34 @@
+// Submission/completion ring, shared between a process and
+// the kernel; see ring.c.
+
+#define RING_ENTRIES 64  // a power of 2; the ring fits in a page
+
+// Operations, each like the system call of the same name.
+#define RING_READ   1
+#define RING_WRITE  2
+#define RING_CLOSE  3
+#define RING_FSTAT  4
+
+// Submission queue entry
+struct sqe {
+  int op;       // RING_READ, ...
+  int fd;
+  uint64 addr;  // buffer, or struct stat for RING_FSTAT
+  uint len;
+  uint64 data;  // passed back in the cqe
+};
+
+// Completion queue entry
+struct cqe {
+  uint64 data;  // from the sqe
+  int res;      // what the system call would have returned
+};
+
+struct ring {
+  uint sqhead;  // next sqe the kernel takes
+  uint sqtail;  // next free sqe; advanced by the process
+  uint cqhead;  // next cqe the process takes; advanced by it
+  uint cqtail;  // next free cqe
+  struct sqe sq[RING_ENTRIES];
+  struct cqe cq[RING_ENTRIES];
+};
@@ -8,22 +8,44 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "lockstat.h"
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  initlock(&lk->lk, name);
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->n = 0;
+  lk->ncontend = 0;
+  lk->waittime = 0;
+  lk->slot = lockregister(lk, LOCK_SLEEP);
+}
+
+// Unregister lk, whose memory is about to be freed.
+void
+freesleeplock(struct sleeplock *lk)
+{
+  lockunregister(lk->slot);
+  lk->slot = -1;
+  freelock(&lk->lk);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint64 start;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  lk->n++;
+  if(lk->locked){
+    start = r_time();
+    while (lk->locked) {
+      sleep(lk, &lk->lk);
+    }
+    lk->ncontend++;
+    lk->waittime += r_time() - start;
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
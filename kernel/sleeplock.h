@@ -6,5 +6,11 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // For contention statistics:
+  int n;             // Number of acquiresleep() calls.
+  int ncontend;      // acquiresleep() calls that had to sleep.
+  uint64 waittime;   // Time spent sleeping, in time CSR units.
+  int slot;          // Index in the lock registry, or -1.
 };
 
@@ -7,6 +7,65 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "sleeplock.h"
+#include "lockstat.h"
+
+#define NLOCKTAB 1024
+
+// Locks copied out by lockstats() per acquire.
+#define LOCKBATCH 16
+
+// Registry of every lock, so that lockstats() can report on
+// them.  initlock() and initsleeplock() register each lock;
+// a lock in memory that is freed must be unregistered with
+// freelock() or freesleeplock() first.  locktablock keeps
+// lockstats() from reading a lock as it is unregistered.
+static struct {
+  void *lk;
+  int type;    // LOCK_SPIN or LOCK_SLEEP
+} locktab[NLOCKTAB];
+static struct spinlock locktablock;
+
+// Add lk to the registry.
+// Returns its slot, or -1 if the registry is full.
+int
+lockregister(void *lk, int type)
+{
+  int i;
+
+  acquire(&locktablock);
+  for(i = 0; i < NLOCKTAB; i++){
+    if(locktab[i].lk == 0){
+      locktab[i].lk = lk;
+      locktab[i].type = type;
+      break;
+    }
+  }
+  release(&locktablock);
+  return i < NLOCKTAB ? i : -1;
+}
+
+// Remove the lock in slot from the registry.
+void
+lockunregister(int slot)
+{
+  if(slot < 0)
+    return;
+  acquire(&locktablock);
+  locktab[slot].lk = 0;
+  release(&locktablock);
+}
+
+// Set up locktablock; called first in main().
+// It can't register itself: lockregister() acquires it.
+void
+lockinit(void)
+{
+  locktablock.name = "locktab";
+  locktablock.locked = 0;
+  locktablock.cpu = 0;
+  locktablock.slot = -1;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -14,6 +73,19 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->n = 0;
+  lk->nts = 0;
+  lk->ncontend = 0;
+  lk->spintime = 0;
+  lk->slot = lockregister(lk, LOCK_SPIN);
+}
+
+// Unregister lk, whose memory is about to be freed.
+void
+freelock(struct spinlock *lk)
+{
+  lockunregister(lk->slot);
+  lk->slot = -1;
 }
 
 // Acquire the lock.
@@ -29,8 +101,16 @@ acquire(struct spinlock *lk)
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  __sync_fetch_and_add(&lk->n, 1);
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    uint64 start = r_time();
+    do {
+      __sync_fetch_and_add(&lk->nts, 1);
+    } while(__sync_lock_test_and_set(&lk->locked, 1) != 0);
+    // held now, so no atomics needed.
+    lk->ncontend++;
+    lk->spintime += r_time() - start;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -108,3 +188,47 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Copy out the statistics of up to n registered locks, as an
+// array of struct lockstat at user address addr.
+// Returns the number copied, or -1.
+int
+lockstats(uint64 addr, int n)
+{
+  struct lockstat batch[LOCKBATCH], *st;
+  struct spinlock *sl;
+  struct sleeplock *sk;
+  int i = 0, m, tot = 0;
+
+  while(i < NLOCKTAB && tot < n){
+    // copyout() may fault, so not while holding locktablock.
+    acquire(&locktablock);
+    for(m = 0; i < NLOCKTAB && m < LOCKBATCH && tot + m < n; i++){
+      if(locktab[i].lk == 0)
+        continue;
+      st = &batch[m++];
+      memset(st, 0, sizeof(*st));
+      st->type = locktab[i].type;
+      if(st->type == LOCK_SPIN){
+        sl = locktab[i].lk;
+        safestrcpy(st->name, sl->name, sizeof(st->name));
+        st->n = sl->n;
+        st->ncontend = sl->ncontend;
+        st->nspin = sl->nts;
+        st->usec = sl->spintime / (TIMEFREQ / 1000000);
+      } else {
+        sk = locktab[i].lk;
+        safestrcpy(st->name, sk->name, sizeof(st->name));
+        st->n = sk->n;
+        st->ncontend = sk->ncontend;
+        st->usec = sk->waittime / (TIMEFREQ / 1000000);
+      }
+    }
+    release(&locktablock);
+    if(m > 0 && copyout(myproc()->pagetable, addr + tot*sizeof(batch[0]),
+                        (char*)batch, m*sizeof(batch[0])) < 0)
+      return -1;
+    tot += m;
+  }
+  return tot;
+}
@@ -5,5 +5,12 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For contention statistics:
+  int n;             // Number of acquire() calls.
+  int nts;           // Failed test-and-set attempts while spinning.
+  int ncontend;      // acquire() calls that had to spin.
+  uint64 spintime;   // Time spent spinning, in time CSR units.
+  int slot;          // Index in the lock registry, or -1.
 };
 
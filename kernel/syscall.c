@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysstat.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -104,6 +105,22 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_nsleep(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_trace(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_profstart(void);
+extern uint64 sys_profstop(void);
+extern uint64 sys_profread(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_ringsetup(void);
+extern uint64 sys_ringenter(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,17 +144,125 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_nsleep]  sys_nsleep,
+[SYS_splice]  sys_splice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_trace]   sys_trace,
+[SYS_sysstat] sys_sysstat,
+[SYS_profstart] sys_profstart,
+[SYS_profstop] sys_profstop,
+[SYS_profread] sys_profread,
+[SYS_lockstat] sys_lockstat,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
 };
 
+static char *syscallnames[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_nsleep]  "nsleep",
+[SYS_splice]  "splice",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_pread]   "pread",
+[SYS_pwrite]  "pwrite",
+[SYS_mmap]    "mmap",
+[SYS_munmap]  "munmap",
+[SYS_trace]   "trace",
+[SYS_sysstat] "sysstat",
+[SYS_profstart] "profstart",
+[SYS_profstop] "profstop",
+[SYS_profread] "profread",
+[SYS_lockstat] "lockstat",
+[SYS_ringsetup] "ringsetup",
+[SYS_ringenter] "ringenter",
+};
+
+// Call counts and latency histograms, updated atomically.
+// time is in time CSR units, converted by sysstats().
+static struct {
+  uint ncall;
+  uint64 time;
+  uint lat[NSCLAT];
+} scstat[NELEM(syscalls)];
+
+// Record a call of system call num that took t time CSR units.
+static void
+sysrecord(int num, uint64 t)
+{
+  uint64 us;
+  int i;
+
+  __sync_fetch_and_add(&scstat[num].ncall, 1);
+  __sync_fetch_and_add(&scstat[num].time, t);
+  us = t / (TIMEFREQ / 1000000);
+  for(i = 0; us > 1 && i < NSCLAT-1; i++)
+    us >>= 1;
+  __sync_fetch_and_add(&scstat[num].lat[i], 1);
+}
+
+// Copy out the statistics of the first n system call numbers
+// as an array of struct sysstat at user address addr.
+// Returns the number of system call numbers, or -1.
+int
+sysstats(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct sysstat st;
+
+  if(n > NELEM(syscalls))
+    n = NELEM(syscalls);
+  for(int i = 0; i < n; i++){
+    memset(&st, 0, sizeof(st));
+    if(syscallnames[i])
+      safestrcpy(st.name, syscallnames[i], sizeof(st.name));
+    st.ncall = scstat[i].ncall;
+    st.usec = scstat[i].time / (TIMEFREQ / 1000000);
+    memmove(st.lat, scstat[i].lat, sizeof(st.lat));
+    if(copyout(p->pagetable, addr + i*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NELEM(syscalls);
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 start;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    start = r_time();
     p->trapframe->a0 = syscalls[num]();
+    sysrecord(num, r_time() - start);
+    if(p->tracemask & (1ULL << num))
+      printf("%d: syscall %s -> %d\n", p->pid, syscallnames[num], p->trapframe->a0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -20,3 +20,19 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_nsleep 22
+#define SYS_splice 23
+#define SYS_readv  24
+#define SYS_writev 25
+#define SYS_pread  26
+#define SYS_pwrite 27
+#define SYS_mmap   28
+#define SYS_munmap 29
+#define SYS_trace  30
+#define SYS_sysstat 31
+#define SYS_profstart 32
+#define SYS_profstop 33
+#define SYS_profread 34
+#define SYS_lockstat 35
+#define SYS_ringsetup 36
+#define SYS_ringenter 37
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -75,7 +76,7 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
-  return fileread(f, p, n);
+  return fileread(f, 1, p, n);
 }
 
 uint64
@@ -88,7 +89,147 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  return filewrite(f, 1, p, n);
+}
+
+// common code for readv() and writev(): read or write the
+// buffers in the user array of struct iovec, in order.
+// stops at the first short transfer.
+static int
+filerwv(int write)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 uiov;
+  int cnt, i, r, tot;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &uiov) < 0 || argint(2, &cnt) < 0)
+    return -1;
+  if(cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, cnt*sizeof(iov[0])) < 0)
+    return -1;
+  for(i = 0; i < cnt; i++)
+    if((int)iov[i].iov_len < 0)
+      return -1;
+
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if(write)
+      r = filewrite(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    else
+      r = fileread(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+    // a pipe or device would block waiting for more.
+    if(!write && r > 0 && f->type != FD_INODE)
+      break;
+  }
+  return tot;
+}
+
+uint64
+sys_readv(void)
+{
+  return filerwv(0);
+}
+
+uint64
+sys_writev(void)
+{
+  return filerwv(1);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(n < 0 || off < 0)
+    return -1;
+  return filepread(f, 1, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(n < 0 || off < 0)
+    return -1;
+  return filepwrite(f, 1, p, n, off);
+}
+
+// move up to n bytes between a pipe and another file
+// without copying them through user space.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// map a file, or anonymous memory with MAP_ANONYMOUS,
+// into the address space.  the address argument is a
+// hint that this kernel ignores.
+uint64
+sys_mmap(void)
+{
+  struct file *f = 0;
+  int len, prot, flags, off;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argint(5, &off) < 0)
+    return -1;
+  if((flags & MAP_ANONYMOUS) == 0 && argfd(4, 0, &f) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  return mmap(f, len, prot, flags, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr;
+  int len;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+// set up this process's submission/completion ring.
+uint64
+sys_ringsetup(void)
+{
+  return ringsetup();
+}
+
+// carry out up to n operations queued on the ring.
+uint64
+sys_ringenter(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return ringenter(n);
 }
 
 uint64
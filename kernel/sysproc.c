@@ -56,23 +56,84 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
+  if(n <= 0)
+    return 0;
+  return timersleep(r_time() + (uint64)n * TICKINTERVAL);
+}
+
+// sleep for at least n nanoseconds.
+uint64
+sys_nsleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return timersleep(r_time() + (ns * (TIMEFREQ/1000000) + 999) / 1000);
+}
+
+// trace the system calls in mask, 1<<SYS_xxx, made by
+// this process and the children it forks from now on.
+uint64
+sys_trace(void)
+{
+  uint64 mask;
+
+  if(argaddr(0, &mask) < 0)
+    return -1;
+  myproc()->tracemask = mask;
   return 0;
 }
 
+uint64
+sys_sysstat(void)
+{
+  uint64 st;
+  int n;
+
+  if(argaddr(0, &st) < 0 || argint(1, &n) < 0)
+    return -1;
+  return sysstats(st, n);
+}
+
+uint64
+sys_profstart(void)
+{
+  profstart();
+  return 0;
+}
+
+uint64
+sys_profstop(void)
+{
+  return profstop();
+}
+
+uint64
+sys_profread(void)
+{
+  uint64 buf;
+  int n;
+
+  if(argaddr(0, &buf) < 0 || argint(1, &n) < 0)
+    return -1;
+  return profread(buf, n);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 st;
+  int n;
+
+  if(argaddr(0, &st) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockstats(st, n);
+}
+
 uint64
 sys_kill(void)
 {
@@ -83,15 +144,12 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
+// return how many clock ticks have passed
 // since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  // ticks is only brought up to date by timer interrupts,
+  // which idle CPUs don't take.
+  return r_time() / TICKINTERVAL;
 }
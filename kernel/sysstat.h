@@ -0,0 +1,12 @@
+// Per-system-call statistics, as returned by sysstat().
+
+#define NSCLAT 16  // latency histogram buckets
+
+struct sysstat {
+  char name[12];      // system call name, "" if unused
+  uint ncall;         // calls made
+  uint64 usec;        // total time in the call (microseconds)
+  uint lat[NSCLAT];   // lat[i] counts calls taking less than
+                      // 2^(i+1) us (at least 2^i, for i > 0);
+                      // the last bucket also holds longer calls
+};
@@ -0,0 +1,277 @@
+// Timers and per-CPU timer interrupts.
+//
+// Processes sleeping until a deadline wait on a timer wheel,
+// so that each is woken only at its deadline.
+//
+// Each CPU programs its own next timer interrupt: for the
+// wheel's next deadline, and also for the next tick while it
+// runs a process, which may need to be preempted, and for the
+// next sample while profiling (see prof.c).  An idle CPU is
+// interrupted only for the wheel, and otherwise sleeps in wfi
+// until there is something to do ("tickless idle").  Another CPU
+// that has work for an idle one wakes it with a software
+// interrupt (see kickidle()).
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// A hierarchical timer wheel.  Time is counted in jiffies of
+// 2^GRANBITS time CSR units.  Level 0 has a slot for each of
+// the next WHEELSIZE jiffies; a slot at level L spans
+// WHEELSIZE^L jiffies, and its timers are moved ("cascaded")
+// to lower levels as the wheel reaches them.  Adding and
+// removing a timer is O(1), and the clock interrupt only
+// visits the slots that have timers due.  Protected by
+// tickslock.
+#define GRANBITS  10   // about 100us at 10 MHz
+#define WHEELBITS 6
+#define WHEELSIZE (1 << WHEELBITS)
+#define NWHEEL    4
+
+struct timer {
+  uint64 when;          // time CSR value at which to fire
+  int fired;
+  struct timer *next;
+  struct timer **pprev; // &previous timer's next, or the slot
+  int lvl, slot;        // where on the wheel
+};
+
+static struct {
+  uint64 base;                          // next jiffy to process
+  struct timer *slot[NWHEEL][WHEELSIZE];
+  uint64 busy[NWHEEL];                  // bitmaps of non-empty slots
+  int n;                                // timers on the wheel
+} wheel;
+
+// Put t in the slot for its deadline.
+static void
+wheeladd(struct timer *t)
+{
+  uint64 j, delta;
+  int lvl, i;
+
+  j = (t->when + (1L << GRANBITS) - 1) >> GRANBITS;
+  if(j < wheel.base)
+    j = wheel.base;
+  delta = j - wheel.base;
+  for(lvl = 0; lvl < NWHEEL-1; lvl++)
+    if(delta < (1L << (WHEELBITS * (lvl+1))))
+      break;
+  if(lvl == NWHEEL-1 && delta >= (1L << (WHEELBITS * NWHEEL)))
+    j = wheel.base + (1L << (WHEELBITS * NWHEEL)) - 1;  // re-added when reached
+  i = (j >> (WHEELBITS * lvl)) & (WHEELSIZE-1);
+
+  t->lvl = lvl;
+  t->slot = i;
+  t->next = wheel.slot[lvl][i];
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = &wheel.slot[lvl][i];
+  wheel.slot[lvl][i] = t;
+  wheel.busy[lvl] |= 1L << i;
+  wheel.n++;
+}
+
+// Take t off the wheel.
+static void
+wheeldel(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  wheel.n--;
+  if(wheel.slot[t->lvl][t->slot] == 0)
+    wheel.busy[t->lvl] &= ~(1L << t->slot);
+}
+
+// Take all timers off slot i at level lvl, as a list.
+static struct timer*
+wheeltake(int lvl, int i)
+{
+  struct timer *t = wheel.slot[lvl][i];
+
+  wheel.slot[lvl][i] = 0;
+  wheel.busy[lvl] &= ~(1L << i);
+  for(struct timer *u = t; u; u = u->next)
+    wheel.n--;
+  return t;
+}
+
+// Return the first non-empty slot at level 0 with index at
+// least i, or -1.
+static int
+nextslot(int i)
+{
+  for(; i < WHEELSIZE; i++)
+    if(wheel.busy[0] & (1L << i))
+      return i;
+  return -1;
+}
+
+// Sleep until the time CSR reaches when.
+// Returns 0, or -1 if the process was killed.
+int
+timersleep(uint64 when)
+{
+  struct timer t;
+  int r = 0;
+
+  t.when = when;
+  t.fired = 0;
+  acquire(&tickslock);
+  if(r_time() >= when){
+    release(&tickslock);
+    return 0;
+  }
+  wheeladd(&t);
+  // make sure this CPU's timer goes off in time.
+  if(when < mycpu()->timer){
+    mycpu()->timer = when;
+    *(uint64*)CLINT_MTIMECMP(cpuid()) = when;
+  }
+  while(!t.fired){
+    if(myproc()->killed){
+      wheeldel(&t);
+      r = -1;
+      break;
+    }
+    sleep(&t, &tickslock);
+  }
+  release(&tickslock);
+  return r;
+}
+
+// Fire the timers that are due at time now.
+// Caller must hold tickslock.
+void
+timerexpire(uint64 now)
+{
+  uint64 target = now >> GRANBITS;
+  uint64 next;
+  struct timer *t, *list;
+  int i, s, lvl;
+
+  while(wheel.base <= target){
+    if(wheel.n == 0){
+      wheel.base = target + 1;
+      break;
+    }
+
+    // At the start of each turn of a level, cascade the
+    // timers in the next slot of the level above.
+    i = wheel.base & (WHEELSIZE-1);
+    for(lvl = 1; i == 0 && lvl < NWHEEL; lvl++){
+      i = (wheel.base >> (WHEELBITS * lvl)) & (WHEELSIZE-1);
+      for(list = wheeltake(lvl, i); (t = list) != 0; ){
+        list = t->next;
+        wheeladd(t);
+      }
+    }
+
+    i = wheel.base & (WHEELSIZE-1);
+    for(list = wheeltake(0, i); (t = list) != 0; ){
+      list = t->next;
+      if(t->when > now){
+        wheeladd(t);  // clamped to the wheel's range
+        continue;
+      }
+      t->fired = 1;
+      wakeup(t);
+    }
+
+    // Skip ahead to the next non-empty slot, or the next
+    // cascade, whichever comes first.
+    next = (wheel.base | (WHEELSIZE-1)) + 1;
+    if((s = nextslot(i + 1)) >= 0)
+      next = wheel.base - i + s;
+    if(next > target + 1)
+      next = target + 1;
+    wheel.base = next;
+  }
+}
+
+// Return the earliest deadline of the timers at level lvl,
+// or -1 if none.  The first non-empty slot the wheel will
+// reach holds them, unsorted.  Level 0's current slot has
+// yet to be processed; a higher level's current slot has
+// already been cascaded, so it is reached last.
+static uint64
+levelnext(int lvl)
+{
+  uint64 when = -1;
+  struct timer *t;
+  int i, k;
+
+  if(wheel.busy[lvl] == 0)
+    return -1;
+  i = (wheel.base >> (WHEELBITS * lvl)) & (WHEELSIZE-1);
+  for(k = (lvl > 0); k <= WHEELSIZE; k++)
+    if(wheel.busy[lvl] & (1L << ((i + k) & (WHEELSIZE-1))))
+      break;
+  for(t = wheel.slot[lvl][(i + k) & (WHEELSIZE-1)]; t; t = t->next)
+    if(t->when < when)
+      when = t->when;
+  return when;
+}
+
+// Return the time of the next timer interrupt the wheel
+// needs, or -1 if none: the start of the jiffy in which its
+// earliest timer is due.  Caller must hold tickslock.
+static uint64
+timernext(void)
+{
+  uint64 when = -1, w;
+  int lvl;
+
+  if(wheel.n == 0)
+    return -1;
+  for(lvl = 0; lvl < NWHEEL; lvl++)
+    if((w = levelnext(lvl)) < when)
+      when = w;
+  return ((when + (1L << GRANBITS) - 1) >> GRANBITS) << GRANBITS;
+}
+
+// Program this CPU's next timer interrupt.
+// Must be called with interrupts disabled.
+void
+clockset(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now, when;
+
+  acquire(&tickslock);
+  when = timernext();
+  release(&tickslock);
+  now = r_time();
+  if(c->proc){
+    if(c->tick <= now)
+      c->tick = now + TICKINTERVAL;
+    if(c->tick < when)
+      when = c->tick;
+    if(profiling && now + PROFINTERVAL < when)
+      when = now + PROFINTERVAL;
+  }
+  c->timer = when;
+  *(uint64*)CLINT_MTIMECMP(cpuid()) = when;
+}
+
+// Wake up some idle CPU, if there is one, so that it can
+// steal work from this CPU's run queue.
+// Must be called with interrupts disabled.
+void
+kickidle(void)
+{
+  int id = cpuid();
+
+  for(int i = 0; i < NCPU; i++){
+    if(i != id && cpus[i].idle){
+      *(uint32*)CLINT_MSIP(i) = 1;
+      return;
+    }
+  }
+}
@@ -29,6 +29,31 @@ trapinithart(void)
   w_stvec((uint64)kernelvec);
 }
 
+// Handle a page fault from user space: a store to a
+// copy-on-write page, a page of the program not yet paged in
+// from its executable, or an untouched heap page.
+// Returns 0 if handled, -1 if not a page fault it can fix.
+static int
+pagefault(struct proc *p, uint64 scause, uint64 va)
+{
+  int r;
+
+  if(scause != 12 && scause != 13 && scause != 15)
+    return -1;
+  if(scause == 15 && uvmcow(p->pagetable, va) == 0)
+    return 0;
+
+  // paging in from the executable or a mapped file may sleep.
+  intr_on();
+  if((r = execfault(p, va)) <= 0)
+    return r;
+  if((r = vmafault(p, va)) <= 0)
+    return r;
+  if(scause != 12 && uvmlazy(p->pagetable, va, p->sz) == 0)
+    return 0;
+  return -1;
+}
+
 //
 // handle an interrupt, exception, or system call from user space.
 // called from trampoline.S
@@ -37,6 +62,7 @@ void
 usertrap(void)
 {
   int which_dev = 0;
+  uint64 scause, stval;
 
   if((r_sstatus() & SSTATUS_SPP) != 0)
     panic("usertrap: not from user mode");
@@ -49,8 +75,13 @@ usertrap(void)
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
+
+  // pagefault() turns interrupts on, and an interrupt
+  // overwrites scause and stval, so read them now.
+  scause = r_scause();
+  stval = r_stval();
   
-  if(r_scause() == 8){
+  if(scause == 8){
     // system call
 
     if(p->killed)
@@ -67,17 +98,20 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(pagefault(p, scause, stval) == 0){
+    // ok
   } else {
-    printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
-    printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
+    printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+    printf("            sepc=%p stval=%p\n", p->trapframe->epc, stval);
     p->killed = 1;
   }
 
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt
+  // and p's time slice is over.
+  if(which_dev == 2 && timeslice())
     yield();
 
   usertrapret();
@@ -149,8 +183,9 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt
+  // and the process's time slice is over.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && timeslice())
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -159,19 +194,27 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
+// Returns 1 if this CPU's scheduling tick is due, or 0 if
+// the interrupt was only for a timer or a profiler sample.
+int
 clockintr()
 {
+  uint64 now = r_time();
+  int tick;
+
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  ticks = now / TICKINTERVAL;
+  timerexpire(now);
   release(&tickslock);
+  tick = mycpu()->tick <= now;
+  clockset();
+  return tick;
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if timer interrupt with a scheduling tick,
+// 1 if other device or timer interrupt,
 // 0 if not recognized.
 int
 devintr()
@@ -201,18 +244,19 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer or
+    // software interrupt, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before clockintr() asks for
+    // the next one.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // sepc and sstatus still describe the interrupted code.
+    if(profiling)
+      profsample(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
+
+    return clockintr() ? 2 : 1;
   } else {
     return 0;
   }
@@ -0,0 +1,7 @@
+// A buffer for readv() and writev().
+struct iovec {
+  void *iov_base;  // start of the buffer
+  uint iov_len;    // its length in bytes
+};
+
+#define IOV_MAX 16  // maximum buffers per readv() or writev()
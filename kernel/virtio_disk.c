@@ -41,6 +41,14 @@ static struct disk {
     struct buf *b;
     char status;
   } info[NUM];
+
+  // disk command headers.
+  // one-for-one with descriptors, for convenience.
+  struct virtio_blk_req ops[NUM];
+
+  // requests added to the avail ring since the
+  // device was last notified.
+  int unkicked;
   
   struct spinlock vdisk_lock;
   
@@ -165,46 +173,55 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// tell the device about requests added to the avail ring.
+// caller must hold vdisk_lock.
+static void
+kick(void)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  if(disk.unkicked == 0)
+    return;
+  disk.unkicked = 0;
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
 
-  acquire(&disk.vdisk_lock);
+// queue a read or write of b without notifying the device
+// or waiting for it.  caller must hold vdisk_lock.
+static void
+submit(struct buf *b, int write)
+{
+  uint64 sector = b->blockno * (BSIZE / 512);
 
   // the spec says that legacy block operations use three
   // descriptors: one for type/reserved/sector, one for
   // the data, one for a 1-byte status result.
 
   // allocate the three descriptors.
+  // if the ring is full, let the device start on what we
+  // have queued so far, so that it can free some.
   int idx[3];
   while(1){
     if(alloc3_desc(idx) == 0) {
       break;
     }
+    kick();
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
   
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
 
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = sector;
+
+  // disk is a global, so it is direct mapped.
+  disk.desc[idx[0]].addr = (uint64) buf0;
+  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
@@ -217,7 +234,7 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
   disk.desc[idx[1]].next = idx[2];
 
-  disk.info[idx[0]].status = 0;
+  disk.info[idx[0]].status = 0xff; // device writes 0 on success
   disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
   disk.desc[idx[2]].len = 1;
   disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
@@ -234,37 +251,100 @@ virtio_disk_rw(struct buf *b, int write)
   disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
   __sync_synchronize();
   disk.avail[1] = disk.avail[1] + 1;
+  disk.unkicked++;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// start a read or write of b and return without waiting.
+// the caller must keep b locked, and may queue more requests
+// before calling virtio_disk_kick() to notify the device
+// once for all of them.  virtio_disk_wait() waits for b.
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  submit(b, write);
+  release(&disk.vdisk_lock);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
+// notify the device of all submitted requests.
+void
+virtio_disk_kick(void)
+{
+  acquire(&disk.vdisk_lock);
+  kick();
+  release(&disk.vdisk_lock);
+}
+
+// wait for virtio_disk_intr() to say b's request has finished.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  kick();
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
+  release(&disk.vdisk_lock);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
+// read or write n locked bufs with a single notification,
+// and wait for all of them.
+void
+virtio_disk_rwv(struct buf **bufs, int n, int write)
+{
+  acquire(&disk.vdisk_lock);
+  for(int i = 0; i < n; i++)
+    submit(bufs[i], write);
+  kick();
+  for(int i = 0; i < n; i++){
+    while(bufs[i]->disk == 1) {
+      sleep(bufs[i], &disk.vdisk_lock);
+    }
+  }
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_rwv(&b, 1, write);
+}
+
 void
 virtio_disk_intr()
 {
   acquire(&disk.vdisk_lock);
 
+  // the device won't raise another interrupt until we tell it
+  // we've seen this interrupt, which the following line does.
+  // this may race with the device writing new entries to
+  // the "used" ring, in which case we may process the new
+  // completion entries in this interrupt, and have nothing to do
+  // in the next interrupt, which is harmless.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+  // the device increments used->id when it
+  // adds an entry to the used ring.
+  __sync_synchronize();
+
   while((disk.used_idx % NUM) != (disk.used->id % NUM)){
+    __sync_synchronize();
     int id = disk.used->elems[disk.used_idx].id;
 
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+
+    struct buf *b = disk.info[id].b;
+    disk.info[id].b = 0;
+    free_chain(id);
+
+    b->disk = 0;   // disk is done with buf
+    wakeup(b);
+    if(b->async)
+      bdone(b);    // no one is waiting; release it
 
     disk.used_idx = (disk.used_idx + 1) % NUM;
   }
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   release(&disk.vdisk_lock);
 }
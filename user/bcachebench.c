@@ -0,0 +1,89 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+// Buffer cache contention benchmark.
+// Each reader repeatedly opens and reads its own small file, so
+// every block lookup hits in the cache and the time is spent in
+// bget()/brelse().  With per-bucket locks the run with N readers
+// should take about as long as the run with one, given N CPUs.
+
+#define MAXREADERS 8
+#define FILEBLOCKS 2
+#define ROUNDS 500
+
+static char buf[FILEBLOCKS * BSIZE];
+
+static void filename(char *name, int i) {
+    strcpy(name, "bcbench0");
+    name[7] += i;
+}
+
+static void reader(int i, int rounds) {
+    char name[16];
+    filename(name, i);
+    for (int r = 0; r < rounds; r++) {
+        int fd = open(name, O_RDONLY);
+        if (fd < 0) {
+            fprintf(2, "bcachebench: open %s failed\n", name);
+            exit(1);
+        }
+        while (read(fd, buf, sizeof(buf)) > 0)
+            ;
+        close(fd);
+    }
+    exit(0);
+}
+
+static int run(int nreaders, int rounds) {
+    int start = uptime();
+    for (int i = 0; i < nreaders; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            fprintf(2, "bcachebench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0)
+            reader(i, rounds);
+    }
+    for (int i = 0; i < nreaders; i++)
+        wait(0);
+    return uptime() - start;
+}
+
+int main(int argc, char *argv[]) {
+    int nreaders = 4;
+    char name[16];
+
+    if (argc > 1)
+        nreaders = atoi(argv[1]);
+    if (nreaders < 1 || nreaders > MAXREADERS) {
+        fprintf(2, "usage: bcachebench [1-%d]\n", MAXREADERS);
+        exit(1);
+    }
+
+    memset(buf, 'b', sizeof(buf));
+    for (int i = 0; i < nreaders; i++) {
+        filename(name, i);
+        int fd = open(name, O_CREATE | O_WRONLY);
+        if (fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            fprintf(2, "bcachebench: create %s failed\n", name);
+            exit(1);
+        }
+        close(fd);
+    }
+
+    int t1 = run(1, ROUNDS);
+    int tn = run(nreaders, ROUNDS);
+    printf("bcachebench: 1 reader %d ticks, %d readers %d ticks\n", t1, nreaders, tn);
+    if (t1 > 0)
+        printf("bcachebench: scaling %d%% of ideal\n", 100 * t1 / (tn > 0 ? tn : 1));
+
+    for (int i = 0; i < nreaders; i++) {
+        filename(name, i);
+        unlink(name);
+    }
+    exit(0);
+}
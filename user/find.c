@@ -1,8 +1,24 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/ring.h"
 #include "user/user.h"
 #include "kernel/fs.h"
 
+// With a ring, find opens a batch of directory entries, then
+// fstat()s and closes them all with one system call instead of
+// two each.
+#define NBATCH 8
+
+struct entry {
+    char name[DIRSIZ + 1];
+    int fd;
+    int ok;
+    struct stat st;
+};
+
+struct ring *ring;
+
+void find(char *path, char *name);
 
 char *
 basename(char *path) {
@@ -20,12 +36,69 @@ basename(char *path) {
     return buf;
 }
 
+// Carry out the fstat()s and close()s queued for a batch,
+// recording which fstat()s succeeded.
+void
+reapbatch(struct entry *e) {
+    struct cqe c;
+
+    ringsubmit(ring);
+    while (ringreap(ring, &c) == 0) {
+        if (c.data < NBATCH)
+            e[c.data].ok = c.res == 0;
+    }
+}
+
+// Look at the entries e[0..n) of the directory whose path,
+// followed by a slash, is in buf; p points past the slash.
+// The open directories above use up file descriptors, so
+// when an open() fails, close the entries opened so far and
+// try again, rather than give up on the entry.
+void
+findbatch(char *buf, char *p, struct entry *e, int n, char *name) {
+    int queued = 0;
+
+    for (int i = 0; i < n; i++) {
+        strcpy(p, e[i].name);
+        e[i].ok = 0;
+        e[i].fd = open(buf, 0);
+        if (e[i].fd < 0 && queued > 0) {
+            reapbatch(e);
+            queued = 0;
+            e[i].fd = open(buf, 0);
+        }
+        if (e[i].fd < 0)
+            continue;
+        ringprep(ring, RING_FSTAT, e[i].fd, &e[i].st, 0, i);
+        ringprep(ring, RING_CLOSE, e[i].fd, 0, 0, NBATCH);
+        queued++;
+    }
+    if (queued > 0)
+        reapbatch(e);
+
+    for (int i = 0; i < n; i++) {
+        strcpy(p, e[i].name);
+        if (e[i].fd < 0) {
+            fprintf(2, "find: cannot open %s\n", buf);
+        } else if (!e[i].ok) {
+            fprintf(2, "find: cannot stat %s\n", buf);
+        } else if (e[i].st.type == T_FILE) {
+            if (strcmp(e[i].name, name) == 0) {
+                printf("%s\n", buf);
+            }
+        } else if (e[i].st.type == T_DIR) {
+            find(buf, name);
+        }
+    }
+}
+
 void
 find(char *path, char *name) {
     char buf[512], *p;
-    int fd;
+    int fd, n = 0;
     struct dirent de;
     struct stat st;
+    struct entry *batch = 0;
 
     if ((fd = open(path, 0)) < 0) {
         fprintf(2, "find: cannot open %s\n", path);
@@ -53,6 +126,10 @@ find(char *path, char *name) {
             strcpy(buf, path);
             p = buf + strlen(buf);
             *p++ = '/';
+            // On the heap, since find() recurses once per level.
+            if (ring) {
+                batch = malloc(NBATCH * sizeof(*batch));
+            }
             while (read(fd, &de, sizeof(de)) == sizeof(de)) {
                 if (de.inum == 0) {
                     continue;
@@ -63,7 +140,21 @@ find(char *path, char *name) {
 
                 memmove(p, de.name, DIRSIZ);
                 p[DIRSIZ] = 0;
-                find(buf, name);
+                if (batch == 0) {
+                    find(buf, name);
+                    continue;
+                }
+                strcpy(batch[n].name, p);
+                if (++n == NBATCH) {
+                    findbatch(buf, p, batch, n, name);
+                    n = 0;
+                }
+            }
+            if (n > 0) {
+                findbatch(buf, p, batch, n, name);
+            }
+            if (batch) {
+                free(batch);
             }
             break;
     }
@@ -72,6 +163,7 @@ find(char *path, char *name) {
 
 int
 main(int argc, char *argv[]) {
+    ring = ringinit();
     if (argc < 3) {
         printf("use 'find <path> name'\n");
     } else {
@@ -0,0 +1,122 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// Lock contention report.
+// Prints the locks that were waited for the longest, totalled over
+// all locks of the same name and kind (all "proc" locks, say).
+// With no command, counts are since boot; with a command, only
+// those while it ran.  -n sets how many locks to print.
+
+#define MAXLOCKS 1024
+
+static struct lockstat before[MAXLOCKS], after[MAXLOCKS];
+
+static int snapshot(struct lockstat *ls) {
+    int n = lockstat(ls, MAXLOCKS);
+    if (n < 0) {
+        fprintf(2, "lockstat: lockstat failed\n");
+        exit(1);
+    }
+    return n;
+}
+
+// Total the locks ls[0..n) into classes by name and type, in place.
+// Returns the number of classes.
+static int classify(struct lockstat *ls, int n) {
+    int nclass = 0;
+    for (int i = 0; i < n; i++) {
+        int j;
+        for (j = 0; j < nclass; j++)
+            if (ls[j].type == ls[i].type && strcmp(ls[j].name, ls[i].name) == 0)
+                break;
+        if (j == nclass) {
+            ls[nclass++] = ls[i];
+            continue;
+        }
+        ls[j].n += ls[i].n;
+        ls[j].ncontend += ls[i].ncontend;
+        ls[j].nspin += ls[i].nspin;
+        ls[j].usec += ls[i].usec;
+    }
+    return nclass;
+}
+
+// Subtract the matching class in b[0..nb) from a, if any.
+// Locks freed meanwhile (pipes') can make a count drop; clamp at 0.
+static void subtract(struct lockstat *a, struct lockstat *b, int nb) {
+    for (int i = 0; i < nb; i++) {
+        if (b[i].type != a->type || strcmp(b[i].name, a->name) != 0)
+            continue;
+        a->n = a->n > b[i].n ? a->n - b[i].n : 0;
+        a->ncontend = a->ncontend > b[i].ncontend ? a->ncontend - b[i].ncontend : 0;
+        a->nspin = a->nspin > b[i].nspin ? a->nspin - b[i].nspin : 0;
+        a->usec = a->usec > b[i].usec ? a->usec - b[i].usec : 0;
+        return;
+    }
+}
+
+static int worse(struct lockstat *a, struct lockstat *b) {
+    if (a->usec != b->usec)
+        return a->usec > b->usec;
+    return a->ncontend > b->ncontend;
+}
+
+static void report(int na, int nb, int top) {
+    for (int i = 0; i < na; i++)
+        subtract(&after[i], before, nb);
+
+    // selection sort, just far enough.
+    for (int i = 0; i < na && i < top; i++) {
+        int best = i;
+        for (int j = i + 1; j < na; j++)
+            if (worse(&after[j], &after[best]))
+                best = j;
+        struct lockstat t = after[i];
+        after[i] = after[best];
+        after[best] = t;
+    }
+
+    printf("lock            kind  acquires contended spins wait-us\n");
+    for (int i = 0; i < na && i < top; i++) {
+        struct lockstat *l = &after[i];
+        if (l->ncontend == 0)
+            break;
+        printf("%s", l->name);
+        for (int k = strlen(l->name); k < 16; k++)
+            printf(" ");
+        printf("%s %d %d %d %d\n", l->type == LOCK_SLEEP ? "sleep" : "spin ",
+               l->n, l->ncontend, l->nspin, (int)l->usec);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int top = 10;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        top = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc < 2) {
+        report(classify(after, snapshot(after)), 0, top);
+        exit(0);
+    }
+
+    int nb = classify(before, snapshot(before));
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "lockstat: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        exec(argv[1], argv + 1);
+        fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+        exit(1);
+    }
+    wait(0);
+    report(classify(after, snapshot(after)), nb, top);
+    exit(0);
+}
@@ -0,0 +1,232 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/elf.h"
+#include "kernel/memlayout.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+// Sampling profiler.
+// Runs a command with the kernel's profiler on, then prints the
+// kernel and user functions that the most samples landed in.
+// Kernel pcs are looked up in /kernel.sym, which the Makefile
+// makes from kernel/kernel's symbol table; user pcs in the symbol
+// table of the command's own ELF file, which _prog.sym lists.
+// User samples of other programs are only counted.
+
+#define MAXSYM 2048
+#define NTOP 15
+#define NSAMPLE 256
+#define DRAINNS 100000000ULL  // 100ms; each CPU buffers about 1s
+
+struct sym {
+    uint64 addr;
+    char *name;
+    int count;
+};
+
+struct symtab {
+    struct sym *syms;
+    int n;
+    int other;  // samples outside any symbol
+};
+
+static struct symtab ktab, utab;
+static struct profsample samples[NSAMPLE];
+static int nkernel, nuser, nforeign;
+
+static void die(char *msg, char *arg) {
+    fprintf(2, "prof: %s %s\n", msg, arg);
+    exit(1);
+}
+
+static void addsym(struct symtab *t, uint64 addr, char *name) {
+    if (t->n == MAXSYM || addr == 0 || name[0] == '.' || name[0] == 0)
+        return;
+    t->syms[t->n].addr = addr;
+    t->syms[t->n].name = name;
+    t->syms[t->n].count = 0;
+    t->n++;
+}
+
+static void sortsyms(struct symtab *t) {
+    for (int i = 1; i < t->n; i++) {
+        struct sym s = t->syms[i];
+        int j = i;
+        for (; j > 0 && t->syms[j - 1].addr > s.addr; j--)
+            t->syms[j] = t->syms[j - 1];
+        t->syms[j] = s;
+    }
+}
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Load "address name" lines, as made by the Makefile's .sym rules.
+static void loadsymfile(struct symtab *t, char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+        die("cannot open", path);
+    char *buf = malloc(st.size + 1);
+    int n = 0, m;
+    while (n < st.size && (m = read(fd, buf + n, st.size - n)) > 0)
+        n += m;
+    close(fd);
+    buf[n] = 0;
+
+    t->syms = malloc(MAXSYM * sizeof(struct sym));
+    for (char *p = buf; *p; ) {
+        uint64 addr = 0;
+        int v;
+        for (; (v = hexval(*p)) >= 0; p++)
+            addr = addr * 16 + v;
+        char *name = (*p == ' ') ? ++p : 0;
+        while (*p && *p != '\n')
+            p++;
+        if (*p)
+            *p++ = 0;
+        if (name)
+            addsym(t, addr, name);
+    }
+    sortsyms(t);
+}
+
+// Load the function symbols of the ELF file at path.
+// Returns its inode number.
+static uint loadelf(struct symtab *t, char *path) {
+    struct elfhdr elf;
+    struct secthdr sh, strsh;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+        die("cannot open", path);
+    if (pread(fd, &elf, sizeof(elf), 0) != sizeof(elf) || elf.magic != ELF_MAGIC)
+        die("not an ELF file:", path);
+
+    t->syms = malloc(MAXSYM * sizeof(struct sym));
+    for (int i = 0; i < elf.shnum; i++) {
+        if (pread(fd, &sh, sizeof(sh), elf.shoff + i * elf.shentsize) != sizeof(sh))
+            die("bad section header in", path);
+        if (sh.type != ELF_SECT_SYMTAB)
+            continue;
+        if (pread(fd, &strsh, sizeof(strsh), elf.shoff + sh.link * elf.shentsize) != sizeof(strsh))
+            die("bad section header in", path);
+        char *strs = malloc(strsh.size);
+        struct elfsym *syms = malloc(sh.size);
+        if (pread(fd, strs, strsh.size, strsh.off) != strsh.size ||
+            pread(fd, syms, sh.size, sh.off) != sh.size)
+            die("cannot read symbols of", path);
+        for (int j = 0; j < sh.size / sizeof(struct elfsym); j++)
+            if (ELF_SYM_TYPE(syms[j].info) == ELF_SYM_FUNC)
+                addsym(t, syms[j].value, strs + syms[j].name);
+        break;
+    }
+    close(fd);
+    sortsyms(t);
+    return st.ino;
+}
+
+// Count a sample at pc against the symbol it falls in.
+static void count(struct symtab *t, uint64 pc) {
+    int lo = 0, hi = t->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (t->syms[mid].addr <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        t->other++;
+    else
+        t->syms[lo - 1].count++;
+}
+
+static void drain(uint ino) {
+    int n;
+    while ((n = profread(samples, NSAMPLE)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (samples[i].pc >= KERNBASE) {
+                nkernel++;
+                count(&ktab, samples[i].pc);
+            } else if (samples[i].inum == ino) {
+                nuser++;
+                count(&utab, samples[i].pc);
+            } else {
+                nforeign++;
+            }
+        }
+    }
+}
+
+static void report(char *what, struct symtab *t, int total) {
+    printf("%s: %d samples\n", what, total);
+    for (int k = 0; k < NTOP; k++) {
+        struct sym *best = 0;
+        for (int i = 0; i < t->n; i++)
+            if (t->syms[i].count > 0 && (best == 0 || t->syms[i].count > best->count))
+                best = &t->syms[i];
+        if (best == 0)
+            break;
+        printf("  %d %d%% %s\n", best->count, best->count * 100 / total, best->name);
+        best->count = 0;
+    }
+    if (t->other)
+        printf("  %d %d%% (unknown)\n", t->other, t->other * 100 / total);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(2, "usage: prof command [args]\n");
+        exit(1);
+    }
+    loadsymfile(&ktab, "/kernel.sym");
+    uint ino = loadelf(&utab, argv[1]);
+
+    // The waiter sets *done when the command exits.
+    volatile int *done = mmap(0, 4096, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (done == (int *)-1)
+        die("mmap failed", "");
+    *done = 0;
+
+    profstart();
+    int pid = fork();
+    if (pid < 0)
+        die("fork failed", "");
+    if (pid == 0) {
+        int cpid = fork();
+        if (cpid == 0) {
+            exec(argv[1], argv + 1);
+            die("cannot exec", argv[1]);
+        }
+        if (cpid > 0)
+            wait(0);
+        *done = 1;
+        exit(0);
+    }
+
+    while (!*done) {
+        drain(ino);
+        nsleep(DRAINNS);
+    }
+    wait(0);
+    int dropped = profstop();
+    drain(ino);
+
+    if (dropped)
+        printf("prof: %d samples dropped\n", dropped);
+    if (nforeign)
+        printf("prof: %d samples in other programs\n", nforeign);
+    if (nkernel)
+        report("kernel", &ktab, nkernel);
+    if (nuser)
+        report(argv[1], &utab, nuser);
+    exit(0);
+}
@@ -0,0 +1,70 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Context switch ping-pong benchmark.
+// Each pair of processes bounces a byte back and forth over two
+// pipes, so every round trip is two sleeps, two wakeups and two
+// trips through the scheduler.  Running several pairs at once
+// shows how the scheduler scales with the number of CPUs.
+
+#define MAXPAIRS 8
+#define ROUNDS 2000
+
+static void bounce(int rfd, int wfd, int rounds, int first) {
+    char c = 'x';
+    for (int i = 0; i < rounds; i++) {
+        if (first && write(wfd, &c, 1) != 1)
+            break;
+        if (read(rfd, &c, 1) != 1)
+            break;
+        if (!first && write(wfd, &c, 1) != 1)
+            break;
+    }
+    exit(0);
+}
+
+static void spawn(int rfd, int wfd, int rounds, int first) {
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "schedbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0)
+        bounce(rfd, wfd, rounds, first);
+}
+
+static int run(int npairs, int rounds) {
+    int start = uptime();
+    for (int i = 0; i < npairs; i++) {
+        int ping[2], pong[2];
+        if (pipe(ping) < 0 || pipe(pong) < 0) {
+            fprintf(2, "schedbench: pipe failed\n");
+            exit(1);
+        }
+        spawn(pong[0], ping[1], rounds, 1);
+        spawn(ping[0], pong[1], rounds, 0);
+        close(ping[0]);
+        close(ping[1]);
+        close(pong[0]);
+        close(pong[1]);
+    }
+    for (int i = 0; i < 2 * npairs; i++)
+        wait(0);
+    return uptime() - start;
+}
+
+int main(int argc, char *argv[]) {
+    int npairs = 1;
+
+    if (argc > 1)
+        npairs = atoi(argv[1]);
+    if (npairs < 1 || npairs > MAXPAIRS) {
+        fprintf(2, "usage: schedbench [1-%d]\n", MAXPAIRS);
+        exit(1);
+    }
+
+    int t = run(npairs, ROUNDS);
+    printf("schedbench: %d pairs x %d round trips: %d ticks\n", npairs, ROUNDS, t);
+    exit(0);
+}
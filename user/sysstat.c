@@ -0,0 +1,82 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+// System call statistics.
+// With no command, print the call counts and latency histograms
+// of every system call made since boot.  With a command, run it
+// and print only the calls made while it ran; -t mask also traces
+// the command's system calls in mask, 1<<SYS_xxx (see
+// kernel/syscall.h), printing each one as it returns.
+
+#define MAXSYS 64
+
+static struct sysstat before[MAXSYS], after[MAXSYS];
+
+static int snapshot(struct sysstat *st) {
+    int n = sysstat(st, MAXSYS);
+    if (n < 0) {
+        fprintf(2, "sysstat: sysstat failed\n");
+        exit(1);
+    }
+    return n < MAXSYS ? n : MAXSYS;
+}
+
+static void print(int n) {
+    for (int i = 0; i < n; i++) {
+        struct sysstat *a = &after[i], *b = &before[i];
+        int ncall = a->ncall - b->ncall;
+        if (ncall == 0)
+            continue;
+        int usec = a->usec - b->usec;
+        printf("%s: calls %d avg %d us, latency (us):", a->name, ncall, usec / ncall);
+        for (int j = 0; j < NSCLAT; j++)
+            if (a->lat[j] != b->lat[j])
+                printf(" <%d:%d", 2 << j, a->lat[j] - b->lat[j]);
+        printf("\n");
+    }
+}
+
+// Like atoi(), but for a 64-bit mask.
+static uint64 atou64(const char *s) {
+    uint64 n = 0;
+    while (*s >= '0' && *s <= '9')
+        n = n * 10 + *s++ - '0';
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    uint64 mask = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        if (argc < 4) {
+            fprintf(2, "usage: sysstat [-t mask command [args]]\n");
+            exit(1);
+        }
+        mask = atou64(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc < 2) {
+        print(snapshot(after));
+        exit(0);
+    }
+
+    snapshot(before);
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "sysstat: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        trace(mask);
+        exec(argv[1], argv + 1);
+        fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+        exit(1);
+    }
+    wait(0);
+    print(snapshot(after));
+    exit(0);
+}
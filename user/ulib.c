@@ -1,6 +1,9 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/ring.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +137,70 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// getpid() and uptime() read the kernel's USYSCALL page
+// instead of making a system call.
+int
+getpid(void)
+{
+  return ((struct usyscall *)USYSCALL)->pid;
+}
+
+int
+uptime(void)
+{
+  return r_time() / ((struct usyscall *)USYSCALL)->tickinterval;
+}
+
+// Submission/completion ring helpers; see kernel/ring.c.
+
+// Set up this process's ring.
+// Returns 0 if there can't be one.
+struct ring*
+ringinit(void)
+{
+  struct ring *r = ringsetup();
+
+  return r == (struct ring*)-1 ? 0 : r;
+}
+
+// Queue an operation, to be carried out by ringsubmit().
+// data comes back in its completion.
+// Returns -1 if the submission queue is full.
+int
+ringprep(struct ring *r, int op, int fd, void *addr, uint len, uint64 data)
+{
+  struct sqe *e;
+
+  if(r->sqtail - r->sqhead >= RING_ENTRIES)
+    return -1;
+  e = &r->sq[r->sqtail % RING_ENTRIES];
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->data = data;
+  r->sqtail++;
+  return 0;
+}
+
+// Carry out the queued operations, with one system call.
+// Stops early if the completion queue fills.
+// Returns the number carried out, or -1.
+int
+ringsubmit(struct ring *r)
+{
+  return ringenter(r->sqtail - r->sqhead);
+}
+
+// Take the next completion.
+// Returns -1 if there is none.
+int
+ringreap(struct ring *r, struct cqe *c)
+{
+  if(r->cqhead == r->cqtail)
+    return -1;
+  *c = r->cq[r->cqhead % RING_ENTRIES];
+  r->cqhead++;
+  return 0;
+}
@@ -1,5 +1,11 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct sysstat;
+struct profsample;
+struct lockstat;
+struct ring;
+struct cqe;
 
 // system calls
 int fork(void);
@@ -19,12 +25,28 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int nsleep(uint64);
+int splice(int, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int trace(uint64);
+int sysstat(struct sysstat*, int);
+int profstart(void);
+int profstop(void);
+int profread(struct profsample*, int);
+int lockstat(struct lockstat*, int);
+struct ring* ringsetup(void);
+int ringenter(int);
 
 // ulib.c
+int getpid(void);
+int uptime(void);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
@@ -40,3 +62,7 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+struct ring* ringinit(void);
+int ringprep(struct ring*, int, int, void*, uint, uint64);
+int ringsubmit(struct ring*);
+int ringreap(struct ring*, struct cqe*);
@@ -4,6 +4,8 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
+#include "kernel/ring.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -523,6 +525,214 @@ writetest(char *s)
   }
 }
 
+// readv() and writev() on a file and a pipe, and their
+// argument checks.
+void
+rwvtest(char *s)
+{
+  struct iovec iov[IOV_MAX+1];
+  char a[4], b[8], c[100];
+  int fd, fds[2];
+
+  unlink("rwvfile");
+  fd = open("rwvfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create rwvfile failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "hello ";
+  iov[0].iov_len = 6;
+  iov[1].iov_base = "vectored ";
+  iov[1].iov_len = 9;
+  iov[2].iov_base = "world";
+  iov[2].iov_len = 5;
+  if(writev(fd, iov, 3) != 20){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the last buffer is only partly filled: a short read at EOF.
+  fd = open("rwvfile", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  iov[2].iov_base = c;
+  iov[2].iov_len = sizeof(c);
+  if(readv(fd, iov, 3) != 20){
+    printf("%s: readv returned the wrong count\n", s);
+    exit(1);
+  }
+  if(memcmp(a, "hell", 4) != 0 || memcmp(b, "o vector", 8) != 0 ||
+     memcmp(c, "ed world", 8) != 0){
+    printf("%s: readv read the wrong data\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, 3) != 0){
+    printf("%s: readv at EOF didn't return 0\n", s);
+    exit(1);
+  }
+
+  // bad arguments.
+  if(readv(fd, iov, IOV_MAX+1) != -1 || readv(fd, iov, -1) != -1){
+    printf("%s: readv accepted a bad count\n", s);
+    exit(1);
+  }
+  iov[1].iov_len = -1;
+  if(readv(fd, iov, 3) != -1){
+    printf("%s: readv accepted a negative length\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwvfile");
+
+  // on a pipe, readv stops after the first data rather than
+  // waiting to fill every buffer.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "abc", 3) != 3){
+    printf("%s: pipe write failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = c;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = c + 10;
+  iov[1].iov_len = 10;
+  if(readv(fds[0], iov, 2) != 3 || memcmp(c, "abc", 3) != 0){
+    printf("%s: readv on a pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// splice() from a pipe to a file and back, with the checks
+// that one side is a pipe and the ends of file and pipe.
+void
+splicetest(char *s)
+{
+  char b[32];
+  int fd, fd2, fds[2];
+
+  unlink("splicefile");
+  fd = open("splicefile", O_CREATE|O_RDWR);
+  if(fd < 0 || pipe(fds) < 0){
+    printf("%s: create splicefile or pipe failed\n", s);
+    exit(1);
+  }
+
+  // pipe to file: takes what the pipe holds, without waiting.
+  if(write(fds[1], "spliced bytes", 13) != 13){
+    printf("%s: pipe write failed\n", s);
+    exit(1);
+  }
+  if(splice(fds[0], fd, sizeof(b)) != 13){
+    printf("%s: splice from pipe to file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // file to pipe: stops at the end of the file.
+  fd = open("splicefile", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open splicefile failed\n", s);
+    exit(1);
+  }
+  if(splice(fd, fds[1], sizeof(b)) != 13){
+    printf("%s: splice from file to pipe failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], b, sizeof(b)) != 13 || memcmp(b, "spliced bytes", 13) != 0){
+    printf("%s: spliced data wrong\n", s);
+    exit(1);
+  }
+  if(splice(fd, fds[1], sizeof(b)) != 0){
+    printf("%s: splice at end of file didn't return 0\n", s);
+    exit(1);
+  }
+
+  // one side must be a pipe, and only one.
+  fd2 = open("splicefile", O_RDWR);
+  if(splice(fd, fd2, 1) != -1 || splice(fds[0], fds[1], 1) != -1){
+    printf("%s: splice without exactly one pipe succeeded\n", s);
+    exit(1);
+  }
+  if(splice(fds[0], fd2, -1) != -1 || splice(fds[0], 99, 1) != -1){
+    printf("%s: splice with bad arguments succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+
+  // a pipe with no writers is at its end.
+  close(fds[1]);
+  fd = open("splicefile", O_RDWR);
+  if(splice(fds[0], fd, sizeof(b)) != 0){
+    printf("%s: splice from a closed pipe didn't return 0\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fds[0]);
+  unlink("splicefile");
+}
+
+// pread() and pwrite() use their own offset, not the file's.
+void
+preadtest(char *s)
+{
+  char b[4];
+  int fd;
+
+  unlink("preadfile");
+  fd = open("preadfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create preadfile failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "0123456789", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "ab", 2, 4) != 2){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  // the file offset is still at the end.
+  if(write(fd, "X", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 4, 3) != 4 || memcmp(b, "3ab6", 4) != 0){
+    printf("%s: pread read the wrong data\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 4, 9) != 2 || memcmp(b, "9X", 2) != 0){
+    printf("%s: short pread at EOF failed\n", s);
+    exit(1);
+  }
+  if(read(fd, b, 1) != 0){
+    printf("%s: pread moved the file offset\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("preadfile", O_RDONLY);
+  if(read(fd, b, 2) != 2 || pread(fd, b, 2, 8) != 2 ||
+     read(fd, b, 2) != 2 || memcmp(b, "23", 2) != 0){
+    printf("%s: pread moved the file offset\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "z", 1, 0) != -1){
+    printf("%s: pwrite to a read-only fd succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("preadfile");
+}
+
 void
 writebig(char *s)
 {
@@ -1006,6 +1216,89 @@ mem(char *s)
   }
 }
 
+int countfree();
+
+// copy-on-write fork: parent and child share pages until one
+// of them stores to a page, so a process using two thirds of
+// free memory can fork, and the child's copies are freed
+// when it exits.
+void
+cowfork(char *s)
+{
+  enum { NCHILD = 10 };
+  int fds[2], pid, xstatus, free0, free1, n, i;
+  char *p;
+
+  n = countfree() * 2 / 3;
+  p = sbrk(n * PGSIZE);
+  if(p == (char*)-1){
+    printf("%s: sbrk(%d pages) failed\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < n; i++)
+    *(int*)(p + i*PGSIZE) = i;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  free0 = countfree();
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // the parent's stores don't show up here.
+    for(i = 0; i < n; i++){
+      if(*(int*)(p + i*PGSIZE) != i){
+        printf("%s: child sees %d in page %d\n", s, *(int*)(p + i*PGSIZE), i);
+        exit(1);
+      }
+    }
+    for(i = 0; i < NCHILD; i++)
+      *(int*)(p + i*PGSIZE) = -i;
+    // copyout() into a shared page.
+    if(read(fds[0], p + NCHILD*PGSIZE, 4) != 4 || memcmp(p + NCHILD*PGSIZE, "cow!", 4) != 0){
+      printf("%s: read into a copy-on-write page failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  *(int*)(p + PGSIZE) = 12345;
+  if(write(fds[1], "cow!", 4) != 4){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+
+  // the child's stores don't show up here.
+  for(i = 0; i <= NCHILD; i++){
+    if(*(int*)(p + i*PGSIZE) != (i == 1 ? 12345 : i)){
+      printf("%s: parent sees %d in page %d\n", s, *(int*)(p + i*PGSIZE), i);
+      exit(1);
+    }
+  }
+  // copyout() into a page that was shared.
+  if(write(fds[1], "moo!", 4) != 4 || read(fds[0], p + (n-1)*PGSIZE, 4) != 4 ||
+     memcmp(p + (n-1)*PGSIZE, "moo!", 4) != 0){
+    printf("%s: read into a formerly shared page failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  free1 = countfree();
+  if(free1 < free0){
+    printf("%s: lost %d free pages across fork and exit\n", s, free0 - free1);
+    exit(1);
+  }
+  sbrk(-n * PGSIZE);
+}
+
 // More file system tests
 
 // two processes write to the same file descriptor
@@ -1737,6 +2030,84 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// a file past NDIRECT+NINDIRECT blocks, which needs the
+// doubly-indirect block: write it, read it back in order,
+// then out of order, which misses bmap()'s cached extent.
+void
+hugefile(char *s)
+{
+  enum { N = NDIRECT + NINDIRECT + 2*NINDIRECT + 7 };
+  int fd, i, b;
+  struct stat st;
+
+  unlink("hugefile");
+  fd = open("hugefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create hugefile\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, i, BSIZE);
+    ((int*)buf)[0] = i;
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write of block %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  if(fstat(fd, &st) < 0 || st.size != N*BSIZE){
+    printf("%s: hugefile has the wrong size\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("hugefile", O_RDONLY);
+  if(fd < 0){
+    printf("%s: cannot open hugefile\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, BSIZE) != BSIZE){
+      printf("%s: read of block %d failed\n", s, i);
+      exit(1);
+    }
+    if(((int*)buf)[0] != i || buf[BSIZE-1] != (char)i){
+      printf("%s: block %d has the wrong contents\n", s, i);
+      exit(1);
+    }
+  }
+  if(read(fd, buf, BSIZE) != 0){
+    printf("%s: read past the end of hugefile\n", s);
+    exit(1);
+  }
+
+  // every 97th block, wrapping around, from the end.
+  for(i = 0, b = N-1; i < N; i++, b = (b + N - 97) % N){
+    if(pread(fd, buf, BSIZE, b*BSIZE) != BSIZE ||
+       ((int*)buf)[0] != b || buf[BSIZE-1] != (char)b){
+      printf("%s: pread of block %d failed\n", s, b);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // truncate frees the doubly-indirect blocks; write again.
+  fd = open("hugefile", O_RDWR|O_TRUNC);
+  if(fd < 0 || fstat(fd, &st) < 0 || st.size != 0){
+    printf("%s: truncate hugefile failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', BSIZE);
+  if(write(fd, buf, BSIZE) != BSIZE || pread(fd, buf, BSIZE, 0) != BSIZE || buf[BSIZE-1] != 'x'){
+    printf("%s: write after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(unlink("hugefile") < 0){
+    printf("%s: unlink hugefile failed\n", s);
+    exit(1);
+  }
+}
+
 void
 fourteen(char *s)
 {
@@ -2526,6 +2897,520 @@ execout(char *s)
   exit(0);
 }
 
+// the byte at offset i of the files the mmap tests create.
+char
+mmapbyte(int i)
+{
+  return 'a' + i % 23;
+}
+
+// create file name holding n bytes of mmapbyte().
+void
+mmapcreate(char *s, char *name, int n)
+{
+  int fd, i, j, m;
+
+  unlink(name);
+  fd = open(name, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create %s failed\n", s, name);
+    exit(1);
+  }
+  for(i = 0; i < n; i += m){
+    m = n - i < BSIZE ? n - i : BSIZE;
+    for(j = 0; j < m; j++)
+      buf[j] = mmapbyte(i + j);
+    if(write(fd, buf, m) != m){
+      printf("%s: write %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// check that file name holds n bytes of mmapbyte(), except
+// that the len bytes at off are c.
+void
+mmapcheck(char *s, char *name, int n, int off, int len, char c)
+{
+  int fd, i, cc, tot;
+  char want;
+
+  fd = open(name, O_RDONLY);
+  if(fd < 0){
+    printf("%s: open %s failed\n", s, name);
+    exit(1);
+  }
+  tot = 0;
+  while((cc = read(fd, buf, BSIZE)) > 0){
+    for(i = 0; i < cc; i++){
+      want = tot+i >= off && tot+i < off+len ? c : mmapbyte(tot+i);
+      if(buf[i] != want){
+        printf("%s: %s byte %d is %x, not %x\n", s, name, tot+i, buf[i], want);
+        exit(1);
+      }
+    }
+    tot += cc;
+  }
+  close(fd);
+  if(tot != n){
+    printf("%s: %s has %d bytes, not %d\n", s, name, tot, n);
+    exit(1);
+  }
+}
+
+// mmap() a file MAP_PRIVATE and MAP_SHARED: the contents,
+// zeroes past the end of the file, and which stores reach
+// the file.
+void
+mmapfile(char *s)
+{
+  enum { N = PGSIZE*2 + PGSIZE/2 };
+  char *p;
+  int fd, i;
+
+  mmapcreate(s, "mmapfile", N);
+  fd = open("mmapfile", O_RDWR);
+  if(fd < 0){
+    printf("%s: open mmapfile failed\n", s);
+    exit(1);
+  }
+
+  // a private mapping reads the file, and keeps stores to itself.
+  p = mmap(0, PGSIZE*3, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < PGSIZE*3; i++){
+    if(p[i] != (i < N ? mmapbyte(i) : 0)){
+      printf("%s: private mapping byte %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  memset(p, 'P', PGSIZE*3);
+  if(munmap(p, PGSIZE*3) < 0){
+    printf("%s: munmap private failed\n", s);
+    exit(1);
+  }
+  mmapcheck(s, "mmapfile", N, 0, 0, 0);
+
+  p = mmap(0, PGSIZE*3, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+
+  // read() into an untouched page of a mapping of the same file.
+  if(pread(fd, p + PGSIZE*2, 10, PGSIZE*2) != 10){
+    printf("%s: read into a mapping of the file read failed\n", s);
+    exit(1);
+  }
+
+  // a shared mapping and read()/write() see each other's changes.
+  memset(p + 100, 'S', PGSIZE);
+  if(pread(fd, buf, 10, PGSIZE) != 10 || buf[0] != 'S' || buf[9] != 'S'){
+    printf("%s: read doesn't see stores to a shared mapping\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "W", 1, PGSIZE*2) != 1){
+    printf("%s: pwrite mmapfile failed\n", s);
+    exit(1);
+  }
+  if(p[PGSIZE*2] != 'W'){
+    printf("%s: shared mapping doesn't see write\n", s);
+    exit(1);
+  }
+  p[PGSIZE*2] = mmapbyte(PGSIZE*2);
+
+  // past the end of the file, stores don't reach the file.
+  p[N] = 'X';
+  if(munmap(p, PGSIZE*3) < 0){
+    printf("%s: munmap shared failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  mmapcheck(s, "mmapfile", N, 100, PGSIZE, 'S');
+
+  // a read-only file can't be mapped shared and writable.
+  fd = open("mmapfile", O_RDONLY);
+  if(mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1){
+    printf("%s: writable shared mmap of a read-only fd succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+}
+
+// munmap() the start, end and middle of mappings; the rest
+// stays mapped, and its stores still reach the file.
+void
+mmappartial(char *s)
+{
+  enum { N = PGSIZE*4 };
+  char *p;
+  int fd, pid, xstatus;
+
+  mmapcreate(s, "mmappartial", N);
+  fd = open("mmappartial", O_RDWR);
+  if(fd < 0){
+    printf("%s: open mmappartial failed\n", s);
+    exit(1);
+  }
+  p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // a hole in the middle, then the first page.
+  p[PGSIZE*1] = 'H';
+  if(munmap(p + PGSIZE*2, PGSIZE) < 0 || munmap(p, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // should fault and be killed.
+    p[PGSIZE*2] = 'x';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: store to an unmapped page succeeded\n", s);
+    exit(1);
+  }
+
+  p[PGSIZE*3] = 'H';
+  if(munmap(p + PGSIZE, PGSIZE) < 0 || munmap(p + PGSIZE*3, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  fd = open("mmappartial", O_RDONLY);
+  if(pread(fd, buf, 1, PGSIZE*1) != 1 || buf[0] != 'H' ||
+     pread(fd, buf, 1, PGSIZE*3) != 1 || buf[0] != 'H'){
+    printf("%s: stores to a partly unmapped mapping lost\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the address space is free again.
+  p = mmap(0, N, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1 || p[0] != 0 || munmap(p, N) < 0){
+    printf("%s: mmap after munmap failed\n", s);
+    exit(1);
+  }
+  unlink("mmappartial");
+}
+
+// run "mmapecho" in a child with its output discarded;
+// return the child's exit status, 3 if exec() failed.
+int
+mmapexecrun(char *s)
+{
+  char *args[] = { "mmapecho", "x", 0 };
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    exec("mmapecho", args);
+    exit(3);
+  }
+  wait(&xstatus);
+  return xstatus;
+}
+
+// a file being run can't be mapped MAP_SHARED, and a file
+// mapped MAP_SHARED can't be run, so stores and write()s
+// never change a running program's text.
+void
+mmapexec(char *s)
+{
+  int fd, fd2, n;
+  char *p;
+
+  // usertests itself is running.
+  fd = open("usertests", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open usertests failed\n", s);
+    exit(1);
+  }
+  if(mmap(0, PGSIZE, PROT_READ, MAP_SHARED, fd, 0) != (char*)-1){
+    printf("%s: mmap shared of a running program succeeded\n", s);
+    exit(1);
+  }
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || munmap(p, PGSIZE) < 0){
+    printf("%s: mmap private of a running program failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // a copy of echo, mapped shared.
+  fd = open("echo", O_RDONLY);
+  fd2 = open("mmapecho", O_CREATE|O_RDWR);
+  if(fd < 0 || fd2 < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(write(fd2, buf, n) != n){
+      printf("%s: write mmapecho failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd2, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  if(mmapexecrun(s) != 3){
+    printf("%s: exec of a file mapped shared succeeded\n", s);
+    exit(1);
+  }
+  if(munmap(p, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(mmapexecrun(s) != 0){
+    printf("%s: exec after munmap failed\n", s);
+    exit(1);
+  }
+  close(fd2);
+  unlink("mmapecho");
+}
+
+// fork() shares MAP_SHARED mappings and copies MAP_PRIVATE
+// ones, and exit() writes back shared stores.
+void
+mmapfork(char *s)
+{
+  enum { N = PGSIZE*2 };
+  char *shared, *private, *anon;
+  int fd, pid, xstatus;
+
+  mmapcreate(s, "mmapfork", N);
+  fd = open("mmapfork", O_RDWR);
+  if(fd < 0){
+    printf("%s: open mmapfork failed\n", s);
+    exit(1);
+  }
+  shared = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  private = mmap(0, N, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  anon = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(shared == (char*)-1 || private == (char*)-1 || anon == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  // touch some pages before the fork, and leave others.
+  private[0] = 'p';
+  anon[0] = 'a';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(shared[0] != mmapbyte(0) || private[0] != 'p' || anon[0] != 'a'){
+      printf("%s: child sees wrong contents\n", s);
+      exit(1);
+    }
+    shared[0] = 'C';
+    shared[PGSIZE] = 'C';
+    private[0] = 'C';
+    anon[PGSIZE] = 'C';
+    // exit without munmap().
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+
+  if(shared[0] != 'C' || shared[PGSIZE] != 'C' || anon[PGSIZE] != 'C'){
+    printf("%s: child's stores to a shared mapping not seen\n", s);
+    exit(1);
+  }
+  if(private[0] != 'p'){
+    printf("%s: child's stores to a private mapping seen\n", s);
+    exit(1);
+  }
+  fd = open("mmapfork", O_RDONLY);
+  if(pread(fd, buf, 1, 0) != 1 || buf[0] != 'C' ||
+     pread(fd, buf, 1, PGSIZE) != 1 || buf[0] != 'C'){
+    printf("%s: exit didn't write back a shared mapping\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(munmap(shared, N) < 0 || munmap(private, N) < 0 || munmap(anon, N) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  unlink("mmapfork");
+}
+
+// a ring carries out its submissions in order and returns
+// each result with its data; RING_CLOSE frees the fd; and
+// ringenter() stops when the completion queue is full.
+void
+ringtest(char *s)
+{
+  struct ring *r;
+  struct stat st;
+  struct cqe c;
+  char b[8];
+  int fd, fd2, i, n;
+  int want[] = { 5, -1, -1, 0, 0, -1 };
+
+  if((r = ringinit()) == 0){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  unlink("ringfile");
+  fd = open("ringfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "ring!", 5) != 5){
+    printf("%s: create ringfile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("ringfile", O_RDONLY);
+
+  ringprep(r, RING_READ, fd, b, 5, 100);
+  ringprep(r, RING_READ, 99, b, 5, 101);    // bad fd
+  ringprep(r, RING_READ, fd, b, -1, 102);   // negative len
+  ringprep(r, RING_FSTAT, fd, &st, 0, 103);
+  ringprep(r, RING_CLOSE, fd, 0, 0, 104);
+  ringprep(r, RING_READ, fd, b, 5, 105);    // closed
+  if(ringsubmit(r) != 6){
+    printf("%s: ringenter didn't carry out every submission\n", s);
+    exit(1);
+  }
+  for(i = 0; ringreap(r, &c) == 0; i++){
+    if(i >= 6 || c.data != 100 + i || c.res != want[i]){
+      printf("%s: completion %d: data %d res %d\n", s, i, (int)c.data, c.res);
+      exit(1);
+    }
+  }
+  if(i != 6 || memcmp(b, "ring!", 5) != 0 || st.type != T_FILE || st.size != 5){
+    printf("%s: wrong results\n", s);
+    exit(1);
+  }
+
+  // RING_CLOSE freed fd, so open() hands it out again.
+  fd2 = open("ringfile", O_RDONLY);
+  if(fd2 != fd){
+    printf("%s: RING_CLOSE didn't free the descriptor\n", s);
+    exit(1);
+  }
+
+  // fill the completion queue; then ringenter() does nothing
+  // until a completion is taken.
+  for(i = 0; i < RING_ENTRIES; i++)
+    ringprep(r, RING_FSTAT, fd2, &st, 0, i);
+  if(ringsubmit(r) != RING_ENTRIES){
+    printf("%s: ringenter didn't fill the completion queue\n", s);
+    exit(1);
+  }
+  ringprep(r, RING_FSTAT, fd2, &st, 0, RING_ENTRIES);
+  if(ringsubmit(r) != 0){
+    printf("%s: ringenter ran with a full completion queue\n", s);
+    exit(1);
+  }
+  if(ringreap(r, &c) != 0 || c.data != 0 || ringsubmit(r) != 1){
+    printf("%s: ringenter didn't resume\n", s);
+    exit(1);
+  }
+  for(n = 1; ringreap(r, &c) == 0; n++){
+    if(c.data != n || c.res != 0){
+      printf("%s: completion %d out of order\n", s, n);
+      exit(1);
+    }
+  }
+  if(n != RING_ENTRIES + 1){
+    printf("%s: lost completions\n", s);
+    exit(1);
+  }
+  close(fd2);
+  unlink("ringfile");
+}
+
+// a forked child has no ring, and exec() drops the ring and
+// unmaps URING (see ringexecchild()).
+void
+ringfork(char *s)
+{
+  char *args[] = { "usertests", "-ringexec", 0 };
+  int pid, xstatus;
+
+  if(ringinit() == 0){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(ringenter(1) != -1){
+      printf("%s: forked child has a ring\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(ringinit() == 0){
+      printf("%s: ringsetup in child failed\n", s);
+      exit(1);
+    }
+    exec("usertests", args);
+    printf("%s: exec usertests failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: exec kept the ring\n", s);
+    exit(1);
+  }
+}
+
+// run by "usertests -ringexec", from ringfork(): after exec()
+// there is no ring, and nothing is mapped at URING.
+void
+ringexecchild(void)
+{
+  int fds[2];
+
+  if(ringenter(1) != -1)
+    exit(1);
+  if(pipe(fds) < 0 || write(fds[1], "x", 1) != 1)
+    exit(1);
+  if(read(fds[0], (char*)URING, 1) != -1)
+    exit(1);
+  exit(0);
+}
+
 //
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
@@ -2623,6 +3508,9 @@ main(int argc, char *argv[])
   int continuous = 0;
   char *justone = 0;
 
+  if(argc == 2 && strcmp(argv[1], "-ringexec") == 0)
+    ringexecchild();
+
   if(argc == 2 && strcmp(argv[1], "-c") == 0){
     continuous = 1;
   } else if(argc == 2 && strcmp(argv[1], "-C") == 0){
@@ -2678,21 +3566,32 @@ main(int argc, char *argv[])
     {stacktest, "stacktest"},
     {opentest, "opentest"},
     {writetest, "writetest"},
+    {rwvtest, "rwvtest"},
+    {preadtest, "preadtest"},
+    {splicetest, "splicetest"},
     {writebig, "writebig"},
     {createtest, "createtest"},
     {openiputtest, "openiput"},
     {exitiputtest, "exitiput"},
     {iputtest, "iput"},
     {mem, "mem"},
+    {cowfork, "cowfork"},
     {pipe1, "pipe1"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
     {fourteen, "fourteen"},
     {bigfile, "bigfile"},
+    {hugefile, "hugefile"},
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {mmapfile, "mmapfile"},
+    {mmappartial, "mmappartial"},
+    {mmapfork, "mmapfork"},
+    {mmapexec, "mmapexec"},
+    {ringtest, "ringtest"},
+    {ringfork, "ringfork"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
@@ -32,7 +32,21 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+entry("nsleep");
+entry("splice");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("mmap");
+entry("munmap");
+entry("trace");
+entry("sysstat");
+entry("profstart");
+entry("profstop");
+entry("profread");
+entry("lockstat");
+entry("ringsetup");
+entry("ringenter");